@@ -0,0 +1,66 @@
+/**
+ * Display list replay check, on the host
+ *
+ * Runs trees_demo.c with DISPLAY_LIST on. Every finished scene is wiped
+ * and drawn again from its display lists, and the replayed framebuffer
+ * must give the same vga_host_checksum as the scene drawn live. A list
+ * that overflowed is not replayed, which fails the check as well, so the
+ * lists have to hold whole scenes:
+ *     make VGA_DIR=<VGA library dir> display_list_host
+ *     ./display_list_host [scenes]
+ * Exits with status 1 on a mismatch or an overflow (default 1 scene).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DISPLAY_LIST 1
+#define main trees_demo_main
+#include "trees_demo.c"
+#undef main
+#include "vga_graphics_host.h"
+
+static int host_scenes = 1 ;            // scenes to check before exiting
+static int host_scene = 0 ;             // scenes finished so far
+static int host_failed = 0 ;            // scenes that failed
+static unsigned long live_sum ;         // checksum of the scene drawn live
+static unsigned long replay_sum ;       // checksum right after the replay
+
+static void dl_scene_drawn(void) {
+    live_sum = vga_host_checksum() ;
+}
+
+// Taken before anything else draws, since the live HUD goes on printing
+static void dl_scene_replayed(void) {
+    replay_sum = vga_host_checksum() ;
+}
+
+void host_scene_done(void) {
+    host_scene++ ;
+    if (dl_core0.overflowed || dl_hud_end.overflowed) {
+        printf("scene %d: overflowed at %u + %u of %d + %d bytes\n", host_scene,
+               dl_core0.size, dl_hud_end.size, DISPLAY_LIST_BYTES, DISPLAY_LIST_HUD_BYTES) ;
+        host_failed++ ;
+    }
+    else {
+        printf("scene %d: live %08lx, replayed %08lx, %u + %u of %d + %d bytes\n", host_scene,
+               live_sum, replay_sum, dl_core0.size, dl_hud_end.size,
+               DISPLAY_LIST_BYTES, DISPLAY_LIST_HUD_BYTES) ;
+        if (replay_sum != live_sum) host_failed++ ;
+    }
+    if (host_scene >= host_scenes) {
+        fflush(stdout) ;
+        exit(host_failed ? 1 : 0) ;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 || (argc > 1 && atoi(argv[1]) <= 0)) {
+        fprintf(stderr, "usage: %s [scenes]\n", argv[0]) ;
+        return 2 ;
+    }
+    if (argc > 1) host_scenes = atoi(argv[1]) ;
+    host_scene_drawn = dl_scene_drawn ;
+    host_scene_replayed = dl_scene_replayed ;
+    return trees_demo_main() ;
+}
@@ -0,0 +1,86 @@
+/**
+ * The fern point queue on two host threads
+ *
+ * One thread runs trees_demo.c's protothread_fern as the producer, as
+ * core 1 does, and one drains the queue with fern_drain_for_us, as core 0
+ * does between L-system batches. Both run against the wall clock. After one
+ * scene of ferns the program reports throughput against the drawing pace,
+ * and queue occupancy (peak, and mean as sampled by the consumer once per
+ * drain call):
+ *     make VGA_DIR=<VGA library dir> fern_ring_host
+ *     ./fern_ring_host [frequency [ppm]]
+ * frequency (Hz, default 2000) stands in for the FFT's peak and sets the
+ * fern thread's pause between leaves. Build it with
+ * SANITIZE=-fsanitize=thread to have ThreadSanitizer watch the queue and
+ * the shim's clock, which both threads read.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define main trees_demo_main
+#include "trees_demo.c"
+#undef main
+#include "vga_graphics_host.h"
+
+static unsigned long occupancy_sum ;    // sum of the consumer's samples
+static unsigned long occupancy_samples ;
+
+static void *producer_main(void *arg) {
+    struct pt pt = {0} ;
+    uint64_t now ;
+    (void)arg ;
+    while (!fern_load(finish_fern)) {
+        protothread_fern(&pt) ;
+        now = time_us_64() ;
+        if (pt.wake > now) sleep_us(pt.wake - now) ;
+    }
+    return NULL ;
+}
+
+static void *consumer_main(void *arg) {
+    (void)arg ;
+    while (!fern_load(finish_fern) || fern_ring_tail != fern_load(fern_ring_head)) {
+        occupancy_sum += fern_load(fern_ring_head) - fern_ring_tail ;
+        occupancy_samples++ ;
+        fern_drain_for_us(1000) ;
+    }
+    return NULL ;
+}
+
+void host_scene_done(void) {
+}
+
+int main(int argc, char **argv) {
+    pthread_t producer, consumer ;
+    uint32_t start, elapsed ;
+
+    max_freqency = (argc > 1) ? atof(argv[1]) : 2000.0 ;
+    setenv("TREES_CLOCK", "real", 1) ;
+    stdio_init_all() ;
+    initVGA() ;
+    srand(12345) ;
+
+    start = time_us_32() ;
+    pthread_create(&consumer, NULL, consumer_main, NULL) ;
+    pthread_create(&producer, NULL, producer_main, NULL) ;
+    pthread_join(producer, NULL) ;
+    pthread_join(consumer, NULL) ;
+    elapsed = time_us_32() - start ;
+
+    printf("fern ring, 2 threads, peak %.0f Hz:\n", max_freqency) ;
+    printf("  %u px drawn in %u us: %u px/s overall, %u px/s while drawing (pace limit %u px/s)\n",
+           fern_drawn, elapsed, (unsigned)(fern_drawn * 1000000ull / max(1u, elapsed)),
+           (unsigned)(fern_drawn * 1000000ull / max(1u, fern_last_draw_time - fern_first_draw_time)),
+           1000000 / FERN_PIXEL_US) ;
+    printf("  queue: peak %u/%d, mean %.1f over %lu samples, %u producer stalls\n",
+           fern_ring_peak, FERN_RING_SIZE, (double)occupancy_sum / max(1ul, occupancy_samples),
+           occupancy_samples, fern_ring_stalls) ;
+    printf("  checksum %08lx\n", vga_host_checksum()) ;
+    if (argc > 2 && vga_host_dump_ppm(argv[2]) != 0) {
+        fprintf(stderr, "fern_ring_host: cannot write %s\n", argv[2]) ;
+        return 1 ;
+    }
+    return 0 ;
+}
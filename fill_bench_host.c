@@ -0,0 +1,102 @@
+/**
+ * Span fills against per-pixel fills, on the host
+ *
+ * First checks that fillRect, drawHLine and drawVLine (which the host
+ * backend now writes as spans) leave the framebuffer byte for byte as the
+ * driver's per-pixel loops would, for random rectangles that may reach
+ * off screen. Then times fillRectFast against the per-pixel fill for a few
+ * sizes the demo uses:
+ *     make VGA_DIR=<VGA library dir> fill_bench_host && ./fill_bench_host
+ * Exits with status 1 on a mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vga_graphics.h"
+#include "vga_graphics_host.h"
+#include "vga_fast.h"
+
+#define TXCOUNT 153600
+extern unsigned char vga_data_array[] ;
+static unsigned char expect[TXCOUNT] ;
+static unsigned char saved[TXCOUNT] ;
+
+// The driver's fillRect: every pixel through drawPixel
+static void fill_per_pixel(short x, short y, short w, short h, char color) {
+    for (int i = x; i < x + w; i++) {
+        for (int j = y; j < y + h; j++) {
+            drawPixel(i, j, color) ;
+        }
+    }
+}
+
+static double now_s(void) {
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return t.tv_sec + t.tv_nsec * 1e-9 ;
+}
+
+// Run fill over the rectangle until 0.2 s have passed, returns ns per call
+static double time_fill(void (*fill)(short, short, short, short, char), short x, short y, short w, short h) {
+    double start = now_s() ;
+    double elapsed ;
+    long calls = 0 ;
+    do {
+        for (int i = 0; i < 16; i++) fill(x, y, w, h, (calls + i) & 7) ;
+        calls += 16 ;
+        elapsed = now_s() - start ;
+    } while (elapsed < 0.2) ;
+    return elapsed * 1e9 / calls ;
+}
+
+int main(void) {
+    static const struct { const char *name ; short x, y, w, h ; } sizes[] = {
+        {"full screen", 0, 0, 640, 480},
+        {"HUD box", 10, 20, 176, 30},
+        {"tower wall", 540, 180, 1, 300},
+        {"7x9 glyph cell", 101, 50, 7, 9},
+    } ;
+    int mismatches = 0 ;
+    short x, y, w, h ;
+    char color ;
+
+    initVGA() ;
+    srand(1) ;
+    for (int i = 0; i < TXCOUNT; i++) vga_data_array[i] = rand() & 0x3F ;
+    for (int n = 0; n < 3000; n++) {
+        x = rand() % 800 - 80 ;
+        y = rand() % 640 - 80 ;
+        w = rand() % 200 - 4 ;
+        h = rand() % 200 - 4 ;
+        color = rand() & 7 ;
+        // per-pixel reference into expect, then the span version in place
+        memcpy(saved, vga_data_array, TXCOUNT) ;
+        switch (n % 3) {
+        case 0: fill_per_pixel(x, y, w, h, color) ; break ;
+        case 1: fill_per_pixel(x, y, w, 1, color) ; break ;
+        case 2: fill_per_pixel(x, y, 1, h, color) ; break ;
+        }
+        memcpy(expect, vga_data_array, TXCOUNT) ;
+        memcpy(vga_data_array, saved, TXCOUNT) ;
+        switch (n % 3) {
+        case 0: fillRect(x, y, w, h, color) ; break ;
+        case 1: drawHLine(x, y, w, color) ; break ;
+        case 2: drawVLine(x, y, h, color) ; break ;
+        }
+        if (memcmp(expect, vga_data_array, TXCOUNT) != 0) {
+            if (mismatches++ < 5) printf("mismatch: op %d at %d,%d size %dx%d\n", n % 3, x, y, w, h) ;
+        }
+    }
+    printf("3000 random fills, hlines and vlines: %d mismatches\n", mismatches) ;
+
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double slow = time_fill(fill_per_pixel, sizes[i].x, sizes[i].y, sizes[i].w, sizes[i].h) ;
+        double fast = time_fill(fillRectFast, sizes[i].x, sizes[i].y, sizes[i].w, sizes[i].h) ;
+        printf("%-15s %3dx%-3d per-pixel %10.0f ns, spans %8.0f ns, %5.1fx\n", sizes[i].name,
+               sizes[i].w, sizes[i].h, slow, fast, slow / fast) ;
+    }
+    return mismatches ? 1 : 0 ;
+}
@@ -0,0 +1,436 @@
+/**
+ * Host stand-ins for the pico SDK and protothreads (see pico_host.h)
+ *
+ * The clock is the only thing that moves. Each read or sleep brings the
+ * ADC/DMA capture up to the new time, then (on core 0) runs every core 1
+ * protothread whose wake time has come. A core 1 thread reads the clock
+ * too, but never steps the other core 1 threads from inside itself.
+ *
+ * Harnesses may read the clock and sleep from several pthreads
+ * (fern_ring_host.c runs the fern producer and the drain on two). One
+ * recursive lock covers the clock, the capture and the core 1 stepping.
+ * It is recursive because core 1's threads read the clock while it is
+ * held. It is let go across real-time waits.
+ *
+ * The ADC's input is a test tone. It steps through one frequency in each
+ * band of the demo's speed ladders, two seconds per step, unless
+ * TREES_TONE gives a fixed frequency in Hz (0 for silence). TREES_WAV
+ * replays a PCM WAV file instead (8 or 16 bit, any rate and channel
+ * count), mixed to mono, converted to the ADC's 8 bit samples and
+ * resampled to its rate by picking the nearest earlier frame. The file
+ * loops. With the virtual clock the replay runs as fast as the host can
+ * analyze it, with TREES_CLOCK=real it runs in real time.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico_host.h"
+
+// Same as the demo's configuration
+#define SYS_CLOCK_HZ 125000000
+#define ADC_CLOCK_HZ 48000000.0
+
+// Tone steps of the default test signal (Hz, 0 = silence)
+static const float host_tone_steps[] = {0, 150, 300, 600, 900, 1200, 2000} ;
+#define HOST_TONE_STEPS (int)(sizeof(host_tone_steps) / sizeof(host_tone_steps[0]))
+#define HOST_TONE_STEP_US 2000000
+
+// ---- clock ----
+static int host_real_clock ;            // TREES_CLOCK=real
+static uint64_t host_clock_us ;         // virtual time
+static struct timespec host_epoch ;     // wall clock at start, for real time
+static int host_core ;                  // core whose code is running
+static pthread_mutex_t host_lock ;
+static pthread_once_t host_lock_once = PTHREAD_ONCE_INIT ;
+
+// ---- protothreads ----
+#define HOST_MAX_THREADS 8
+typedef struct {
+    char (*thread[HOST_MAX_THREADS])(struct pt *) ;
+    struct pt pt[HOST_MAX_THREADS] ;
+    char state[HOST_MAX_THREADS] ;      // last return value
+    int count ;
+} HostCore ;
+static HostCore host_cores[2] ;
+
+// ---- ADC and DMA ----
+adc_hw_t host_adc_hw ;
+adc_hw_t *const adc_hw = &host_adc_hw ;
+dma_hw_t host_dma_hw ;
+dma_hw_t *const dma_hw = &host_dma_hw ;
+static bool host_adc_running ;
+static float host_adc_div ;
+static uint64_t host_adc_start_us ;     // time of adc_run(true)
+static uint64_t host_adc_samples ;      // conversions made since then
+static float host_tone = -1 ;           // TREES_TONE, -1 = stepped tone
+static double host_tone_phase ;
+static unsigned char *host_wav ;        // TREES_WAV as 8 bit mono, NULL = tone
+static uint32_t host_wav_frames ;
+static uint32_t host_wav_rate ;
+typedef struct {
+    dma_channel_config config ;
+    volatile void *write ;
+    const volatile void *read ;
+    uint32_t done ;                     // transfers since configured
+    bool busy ;
+} HostDmaChannel ;
+static HostDmaChannel host_dma[NUM_DMA_CHANNELS] ;
+
+static void host_lock_init(void) {
+    pthread_mutexattr_t attr ;
+    pthread_mutexattr_init(&attr) ;
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) ;
+    pthread_mutex_init(&host_lock, &attr) ;
+    pthread_mutexattr_destroy(&attr) ;
+}
+
+static void host_enter(void) {
+    pthread_once(&host_lock_once, host_lock_init) ;
+    pthread_mutex_lock(&host_lock) ;
+}
+
+static void host_leave(void) {
+    pthread_mutex_unlock(&host_lock) ;
+}
+
+static uint64_t host_now(void) {
+    struct timespec t ;
+    if (!host_real_clock) return host_clock_us ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return (uint64_t)(t.tv_sec - host_epoch.tv_sec) * 1000000
+           + (t.tv_nsec - host_epoch.tv_nsec) / 1000 ;
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24) ;
+}
+
+// Load a PCM WAV file into host_wav. Returns 0, or -1 with a message.
+static int host_wav_load(const char *path) {
+    FILE *f = fopen(path, "rb") ;
+    unsigned char *file = NULL, *p, *fmt = NULL, *data = NULL ;
+    uint32_t size = 0, chunk, data_size = 0, i ;
+    int channels, bits, frame_bytes, c, mix ;
+    long length ;
+
+    if (f != NULL && fseek(f, 0, SEEK_END) == 0 && (length = ftell(f)) >= 12) {
+        size = length ;
+        file = malloc(size) ;
+        rewind(f) ;
+        if (file != NULL && fread(file, 1, size, f) != size) size = 0 ;
+    }
+    if (f != NULL) fclose(f) ;
+    if (file == NULL || size < 12 || memcmp(file, "RIFF", 4) || memcmp(file + 8, "WAVE", 4)) {
+        fprintf(stderr, "pico_host: %s is not a readable WAV file\n", path) ;
+        free(file) ;
+        return -1 ;
+    }
+    // find the fmt and data chunks
+    for (p = file + 12; p + 8 <= file + size; p += 8 + chunk + (chunk & 1)) {
+        chunk = get_le32(p + 4) ;
+        if (chunk > (uint32_t)(file + size - p - 8)) chunk = file + size - p - 8 ;
+        if (!memcmp(p, "fmt ", 4) && chunk >= 16) fmt = p + 8 ;
+        if (!memcmp(p, "data", 4)) {
+            data = p + 8 ;
+            data_size = chunk ;
+        }
+    }
+    channels = fmt ? fmt[2] | (fmt[3] << 8) : 0 ;
+    bits = fmt ? fmt[14] | (fmt[15] << 8) : 0 ;
+    if (fmt == NULL || data == NULL || (fmt[0] | (fmt[1] << 8)) != 1 || channels < 1 || (bits != 8 && bits != 16)) {
+        fprintf(stderr, "pico_host: %s is not 8 or 16 bit PCM\n", path) ;
+        free(file) ;
+        return -1 ;
+    }
+    frame_bytes = channels * bits / 8 ;
+    host_wav_rate = get_le32(fmt + 4) ;
+    host_wav_frames = data_size / frame_bytes ;
+    host_wav = malloc(host_wav_frames ? host_wav_frames : 1) ;
+    if (host_wav == NULL || host_wav_frames == 0 || host_wav_rate == 0) {
+        fprintf(stderr, "pico_host: %s has no audio\n", path) ;
+        free(file) ;
+        free(host_wav) ;
+        host_wav = NULL ;
+        return -1 ;
+    }
+    for (i = 0; i < host_wav_frames; i++) {
+        p = data + i * frame_bytes ;
+        mix = 0 ;
+        for (c = 0; c < channels; c++) {
+            // 8 bit WAV is unsigned, 16 bit signed: both end up as 0..255
+            if (bits == 8) mix += p[c] ;
+            else mix += ((int16_t)(p[2 * c] | (p[2 * c + 1] << 8)) >> 8) + 128 ;
+        }
+        host_wav[i] = mix / channels ;
+    }
+    free(file) ;
+    return 0 ;
+}
+
+// Next ADC conversion, already shifted to 8 bits
+static uint32_t host_adc_convert(void) {
+    float rate = ADC_CLOCK_HZ / (host_adc_div + 1) ;
+    float tone = host_tone ;
+    if (host_wav != NULL) {
+        return host_wav[(uint64_t)(host_adc_samples * (double)host_wav_rate / rate) % host_wav_frames] ;
+    }
+    if (tone < 0) {
+        tone = host_tone_steps[(host_adc_samples * 1000000 / (uint64_t)rate / HOST_TONE_STEP_US)
+                               % HOST_TONE_STEPS] ;
+    }
+    host_tone_phase += 2 * M_PI * tone / rate ;
+    if (host_tone_phase > 2 * M_PI) host_tone_phase -= 2 * M_PI ;
+    return (uint32_t)(128 + (tone > 0 ? 96 * sin(host_tone_phase) : 0)) ;
+}
+
+// One transfer of channel ch
+static void host_dma_transfer(int ch, uint32_t value) {
+    HostDmaChannel *c = &host_dma[ch] ;
+    uint32_t offset = c->config.write_increment ? c->done << c->config.size : 0 ;
+    volatile unsigned char *dst ;
+    if (c->config.ring_write && c->config.ring_bits) offset &= (1u << c->config.ring_bits) - 1 ;
+    dst = (volatile unsigned char *)c->write + offset ;
+    if (c->config.size == DMA_SIZE_8) *dst = value ;
+    else if (c->config.size == DMA_SIZE_16) *(volatile uint16_t *)dst = value ;
+    else *(volatile uint32_t *)dst = value ;
+    c->done++ ;
+    if (--dma_hw->ch[ch].transfer_count == 0) c->busy = false ;
+}
+
+// Run the ADC up to now and hand its conversions to the channels it paces
+static void host_adc_catch_up(uint64_t now) {
+    uint64_t due ;
+    uint32_t sample ;
+    int ch ;
+    if (!host_adc_running) return ;
+    due = (uint64_t)((double)(now - host_adc_start_us) * ADC_CLOCK_HZ / (host_adc_div + 1) / 1e6) ;
+    while (host_adc_samples < due) {
+        sample = host_adc_convert() ;
+        host_adc_samples++ ;
+        adc_hw->fifo = sample ;
+        for (ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+            if (host_dma[ch].busy && host_dma[ch].config.dreq == DREQ_ADC) host_dma_transfer(ch, sample) ;
+        }
+    }
+}
+
+// Step the core 1 threads that are due
+static void host_run_core1(uint64_t now) {
+    HostCore *core = &host_cores[1] ;
+    int i ;
+    if (host_core != 0) return ;
+    host_core = 1 ;
+    for (i = 0; i < core->count; i++) {
+        if (core->state[i] < PT_EXITED && core->pt[i].wake <= now) {
+            core->state[i] = core->thread[i](&core->pt[i]) ;
+        }
+    }
+    host_core = 0 ;
+}
+
+// Earliest wake time of core 1's threads
+static uint64_t host_core1_wake(void) {
+    HostCore *core = &host_cores[1] ;
+    uint64_t wake = UINT64_MAX ;
+    int i ;
+    for (i = 0; i < core->count; i++) {
+        if (core->state[i] < PT_EXITED && core->pt[i].wake < wake) wake = core->pt[i].wake ;
+    }
+    return wake ;
+}
+
+static void host_update(void) {
+    host_adc_catch_up(host_now()) ;
+    host_run_core1(host_now()) ;
+}
+
+// Let time pass until t, running core 1 on the way
+static void host_idle_until(uint64_t t) {
+    uint64_t now, next ;
+    struct timespec wait ;
+    host_enter() ;
+    while ((now = host_now()) < t) {
+        next = t ;
+        if (host_core == 0 && host_core1_wake() < next) next = host_core1_wake() ;
+        if (next > now) {
+            if (host_real_clock) {
+                wait.tv_sec = (next - now) / 1000000 ;
+                wait.tv_nsec = (next - now) % 1000000 * 1000 ;
+                host_leave() ;
+                nanosleep(&wait, NULL) ;
+                host_enter() ;
+            }
+            else host_clock_us = next ;
+        }
+        else if (!host_real_clock) host_clock_us++ ;
+        host_update() ;
+    }
+    host_leave() ;
+}
+
+uint64_t time_us_64(void) {
+    uint64_t now ;
+    host_enter() ;
+    if (!host_real_clock) host_clock_us++ ;
+    host_update() ;
+    now = host_now() ;
+    host_leave() ;
+    return now ;
+}
+
+void (*host_scene_drawn)(void) ;
+void (*host_scene_replayed)(void) ;
+
+uint64_t host_wall_ns(void) {
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec ;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64() ;
+}
+
+void sleep_us(uint64_t us) {
+    host_idle_until(host_now() + us) ;
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t)ms * 1000) ;
+}
+
+bool stdio_init_all(void) {
+    const char *clock = getenv("TREES_CLOCK") ;
+    const char *tone = getenv("TREES_TONE") ;
+    const char *wav = getenv("TREES_WAV") ;
+    host_real_clock = (clock != NULL && strcmp(clock, "real") == 0) ;
+    clock_gettime(CLOCK_MONOTONIC, &host_epoch) ;
+    if (tone != NULL) host_tone = atof(tone) ;
+    if (wav != NULL && host_wav == NULL && host_wav_load(wav) != 0) exit(1) ;
+    return true ;
+}
+
+uint32_t clock_get_hz(enum clock_index clk) {
+    return (clk == clk_sys) ? SYS_CLOCK_HZ : 12000000 ;
+}
+
+void adc_gpio_init(uint gpio) { (void)gpio ; }
+void adc_init(void) { host_adc_running = false ; host_adc_div = 0 ; }
+void adc_select_input(uint input) { (void)input ; }
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {
+    (void)en ; (void)dreq_en ; (void)dreq_thresh ; (void)err_in_fifo ; (void)byte_shift ;
+}
+void adc_set_clkdiv(float clkdiv) { host_adc_div = clkdiv ; }
+
+void adc_run(bool run) {
+    host_adc_catch_up(host_now()) ;
+    if (run && !host_adc_running) {
+        host_adc_start_us = host_now() ;
+        host_adc_samples = 0 ;
+    }
+    host_adc_running = run ;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c ;
+    memset(&c, 0, sizeof(c)) ;
+    c.size = DMA_SIZE_32 ;
+    c.read_increment = true ;
+    c.write_increment = false ;
+    c.dreq = DREQ_FORCE ;
+    c.chain_to = channel ;
+    return c ;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size ;
+}
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) { c->read_increment = incr ; }
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) { c->write_increment = incr ; }
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_write = write ;
+    c->ring_bits = size_bits ;
+}
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) { c->dreq = dreq ; }
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) { c->chain_to = chain_to ; }
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    HostDmaChannel *c = &host_dma[channel] ;
+    c->config = *config ;
+    c->write = write_addr ;
+    c->read = read_addr ;
+    c->done = 0 ;
+    c->busy = false ;
+    dma_hw->ch[channel].transfer_count = transfer_count ;
+    if (trigger) dma_start_channel_mask(1u << channel) ;
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+    HostDmaChannel *c ;
+    const volatile unsigned char *src ;
+    uint32_t value ;
+    int ch ;
+    host_adc_catch_up(host_now()) ;
+    for (ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (!(chan_mask & (1u << ch))) continue ;
+        c = &host_dma[ch] ;
+        c->busy = (dma_hw->ch[ch].transfer_count != 0) ;
+        if (c->config.dreq != DREQ_FORCE) continue ;
+        // unpaced: the whole block moves at once
+        while (c->busy) {
+            src = (const volatile unsigned char *)c->read + (c->config.read_increment ? c->done << c->config.size : 0) ;
+            if (c->config.size == DMA_SIZE_8) value = *src ;
+            else if (c->config.size == DMA_SIZE_16) value = *(const volatile uint16_t *)src ;
+            else value = *(const volatile uint32_t *)src ;
+            host_dma_transfer(ch, value) ;
+        }
+    }
+}
+
+void multicore_reset_core1(void) {
+    host_cores[1].count = 0 ;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    host_core = 1 ;
+    entry() ;
+    host_core = 0 ;
+}
+
+void pt_add_thread(char (*thread)(struct pt *)) {
+    HostCore *core = &host_cores[host_core] ;
+    if (core->count == HOST_MAX_THREADS) {
+        fprintf(stderr, "pico_host: more than %d threads on core %d\n", HOST_MAX_THREADS, host_core) ;
+        exit(1) ;
+    }
+    core->thread[core->count] = thread ;
+    memset(&core->pt[core->count], 0, sizeof(struct pt)) ;
+    core->state[core->count] = PT_WAITING ;
+    core->count++ ;
+}
+
+void pt_host_schedule(void) {
+    HostCore *core = &host_cores[0] ;
+    uint64_t wake ;
+    int i, alive ;
+    if (host_core != 0) return ;
+    while (1) {
+        alive = 0 ;
+        wake = UINT64_MAX ;
+        for (i = 0; i < core->count; i++) {
+            if (core->state[i] >= PT_EXITED) continue ;
+            if (core->pt[i].wake <= time_us_64()) core->state[i] = core->thread[i](&core->pt[i]) ;
+            if (core->state[i] >= PT_EXITED) continue ;
+            alive++ ;
+            if (core->pt[i].wake < wake) wake = core->pt[i].wake ;
+        }
+        if (!alive) return ;
+        host_idle_until(wake) ;
+    }
+}
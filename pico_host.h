@@ -0,0 +1,141 @@
+// Host stand-ins for the parts of the pico SDK and of the protothreads
+// library (pt_cornell_rp2040_v1.h) that trees_demo.c uses, so the demo
+// builds and runs on a Linux box next to vga_graphics_host.c. Build with
+// -DVGA_HOST, which makes trees_demo.c include this header instead of the
+// pico headers.
+//
+// Both cores run on one host thread, against a clock that is virtual by
+// default: every time_us_32/time_us_64 read costs one microsecond and
+// sleeps jump straight to their end, so a run is deterministic and a busy
+// wait takes no more real time than the reads it makes. Core 1's
+// protothreads are stepped from core 0's clock reads whenever they are
+// due, and the ADC/DMA capture fills the sample ring at the ADC's sample
+// rate as the clock moves, from a test tone (TREES_TONE) or a WAV file
+// (TREES_WAV). Set TREES_CLOCK=real in the environment to run against the
+// wall clock instead, for timings or a real-time replay.
+//
+// A sleep on core 1 stops core 0 as well: it is over before core 0's next
+// clock read, so a flag that core 1 sets, sleeps on and clears is never
+// seen by core 0. Core 1 threads wait with PT_YIELD_usec instead. DMA
+// channel chaining is not modeled (the demo's sample channel never runs
+// out of transfers).
+
+#ifndef PICO_HOST_H
+#define PICO_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint ;
+
+// ---- pico/stdlib.h, pico/divider.h, hardware/sync.h ----
+uint32_t time_us_32(void) ;
+uint64_t time_us_64(void) ;
+void sleep_us(uint64_t us) ;
+void sleep_ms(uint32_t ms) ;
+// Also reads the TREES_* settings from the environment
+bool stdio_init_all(void) ;
+#define tight_loop_contents()
+#define __dmb() __sync_synchronize()
+static inline int64_t div_s64s64(int64_t a, int64_t b) { return a / b ; }
+
+// ---- hardware/clocks.h ----
+enum clock_index { clk_ref = 4, clk_sys = 5 } ;
+uint32_t clock_get_hz(enum clock_index clk) ;
+
+// ---- hardware/adc.h ----
+typedef struct {
+    volatile uint32_t fifo ;
+} adc_hw_t ;
+extern adc_hw_t *const adc_hw ;
+void adc_gpio_init(uint gpio) ;
+void adc_init(void) ;
+void adc_select_input(uint input) ;
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) ;
+void adc_set_clkdiv(float clkdiv) ;
+void adc_run(bool run) ;
+
+// ---- hardware/dma.h ----
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 } ;
+#define DREQ_ADC 36
+#define DREQ_FORCE 63
+#define NUM_DMA_CHANNELS 12
+typedef struct {
+    uint8_t size ;              // enum dma_channel_transfer_size
+    bool read_increment ;
+    bool write_increment ;
+    bool ring_write ;           // ring applies to the write address
+    uint8_t ring_bits ;         // log2 ring size in bytes, 0 = no ring
+    uint8_t dreq ;
+    uint8_t chain_to ;          // own channel number = no chaining
+} dma_channel_config ;
+typedef struct {
+    volatile uint32_t read_addr ;
+    volatile uint32_t write_addr ;
+    volatile uint32_t transfer_count ;
+    volatile uint32_t ctrl_trig ;
+} dma_channel_hw_t ;
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS] ;
+} dma_hw_t ;
+extern dma_hw_t *const dma_hw ;
+dma_channel_config dma_channel_get_default_config(uint channel) ;
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) ;
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) ;
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) ;
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) ;
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) ;
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) ;
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) ;
+void dma_start_channel_mask(uint32_t chan_mask) ;
+
+// ---- pico/multicore.h ----
+void multicore_reset_core1(void) ;
+// Registers core 1's threads, they run as the clock reaches their wake time
+void multicore_launch_core1(void (*entry)(void)) ;
+
+// ---- pt_cornell_rp2040_v1.h ----
+// Switch-based local continuations as in the library (no yield inside a
+// switch), and each thread keeps the time it wants to run again.
+struct pt {
+    unsigned short lc ;
+    uint64_t wake ;
+} ;
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2
+#define PT_ENDED   3
+#define PT_THREAD(name_args) char name_args
+#define PT_BEGIN(pt) switch ((pt)->lc) { case 0:
+#define PT_END(pt) } (pt)->lc = 0 ; return PT_ENDED
+// Yield, and come back no sooner than delay_time microseconds later
+#define PT_YIELD_usec(delay_time) do { \
+        pt->wake = time_us_64() + (uint64_t)(delay_time) ; \
+        pt->lc = __LINE__ ; \
+        return PT_YIELDED ; \
+        case __LINE__: ; \
+    } while (0)
+// Add a thread to the scheduler of the core that is running
+void pt_add_thread(char (*thread)(struct pt *)) ;
+// Core 0: run its threads until they have all ended. Core 1: return, its
+// threads are stepped from the clock.
+void pt_host_schedule(void) ;
+#define pt_schedule_start pt_host_schedule()
+
+// ---- host driver ----
+// Wall-clock nanoseconds, whatever TREES_CLOCK says. The demo's boot
+// benchmarks read it, since on the virtual clock every kernel looks free.
+uint64_t host_wall_ns(void) ;
+// Called by trees_demo.c after each scene, before it is cleared. Defined
+// by the program that includes trees_demo.c (trees_host.c).
+void host_scene_done(void) ;
+// With DISPLAY_LIST on, called as each scene is finished, before it is
+// wiped and replayed from its display lists, and right after the replay.
+// NULL unless the program sets them (display_list_host.c), so any host
+// program builds with DISPLAY_LIST on. Neither is called if a list
+// overflowed.
+extern void (*host_scene_drawn)(void) ;
+extern void (*host_scene_replayed)(void) ;
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ * A scene of the demo through the tile-parallel rasterizer, on the host
+ *
+ * Runs trees_demo.c, with LSYS_THICK on, until a scene is finished,
+ * recording the thick segments lsys_flush hands to drawThickSegments and
+ * the pixels the fern drain hands to drawPixel. The recording is then
+ * replayed onto the cleared framebuffer with those same calls (the serial
+ * path the firmware takes), and queued into a 640x480 VgaRaster rendered serially, tiled on
+ * 1 to 32 threads and by vga_raster_render: each render must give the
+ * framebuffer's vga_host_checksum. The same is timed for the recording
+ * scaled up to 3840x2160, and for a 3840x2160 forest of unscaled copies
+ * of it, where every render must match the serial one byte for byte. Each
+ * report gives the commands per render, which vga_raster_render compares
+ * with VGA_RASTER_SERIAL_BELOW:
+ *     make VGA_DIR=<VGA library dir> raster_replay_host
+ *     ./raster_replay_host [scene]
+ * Exits with status 1 on a mismatch. Speedups are only as good as the
+ * cores the host has.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Thick branches, so the brush is checked as well
+#define LSYS_THICK 1
+// Route the demo's drawing through the recorder
+#define drawThickSegments replay_thick_segments
+#define drawPixel replay_pixel
+#define main trees_demo_main
+#include "trees_demo.c"
+#undef main
+#undef drawPixel
+#undef drawThickSegments
+#include "vga_graphics_host.h"
+#include "vga_raster_host.h"
+
+void drawPixel(short x, short y, char color) ;
+void drawThickSegments(const VgaSegment *seg, int count, char color, int radius) ;
+
+#define TXCOUNT 153600
+extern unsigned char vga_data_array[] ;
+
+#define RASTER_TILE 32
+#define RASTER_4K_W 3840
+#define RASTER_4K_H 2160
+#define RASTER_FOREST_OVERLAP 80
+
+// One recorded call: count segments from rec_seg, or a pixel if count is 0
+typedef struct {
+    int first, count ;
+    short x, y ;
+    char color, radius ;
+} ReplayCall ;
+
+static ReplayCall *rec_call ;
+static int rec_calls, rec_call_cap ;
+static VgaSegment *rec_seg ;
+static int rec_segs, rec_seg_cap ;
+static int replay_scene = 1 ;           // scene to record
+static int host_scene = 0 ;             // scenes finished so far
+
+static ReplayCall *rec_next(void) {
+    if (rec_calls == rec_call_cap) {
+        rec_call_cap = rec_call_cap ? 2 * rec_call_cap : 4096 ;
+        rec_call = realloc(rec_call, sizeof(ReplayCall) * rec_call_cap) ;
+        if (rec_call == NULL) {
+            fprintf(stderr, "raster_replay_host: out of memory\n") ;
+            exit(2) ;
+        }
+    }
+    return &rec_call[rec_calls++] ;
+}
+
+void replay_thick_segments(const VgaSegment *seg, int count, char color, int radius) {
+    ReplayCall *c = rec_next() ;
+    if (rec_segs + count > rec_seg_cap) {
+        rec_seg_cap = 2 * (rec_segs + count) ;
+        rec_seg = realloc(rec_seg, sizeof(VgaSegment) * rec_seg_cap) ;
+        if (rec_seg == NULL) {
+            fprintf(stderr, "raster_replay_host: out of memory\n") ;
+            exit(2) ;
+        }
+    }
+    memcpy(&rec_seg[rec_segs], seg, sizeof(VgaSegment) * count) ;
+    c->first = rec_segs ;
+    c->count = count ;
+    c->color = color ;
+    c->radius = radius ;
+    rec_segs += count ;
+    drawThickSegments(seg, count, color, radius) ;
+}
+
+void replay_pixel(short x, short y, char color) {
+    ReplayCall *c = rec_next() ;
+    c->count = 0 ;
+    c->x = x ;
+    c->y = y ;
+    c->color = color ;
+    drawPixel(x, y, color) ;
+}
+
+static double now_s(void) {
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return t.tv_sec + t.tv_nsec * 1e-9 ;
+}
+
+// Queue the recording, coordinates scaled by sx_q1 / 2 and sy_q1 / 2,
+// then moved right by ox and down by oy
+static void queue_scene(VgaRaster *r, int sx_q1, int sy_q1, int ox, int oy) {
+    static VgaSegment scaled[256] ;
+    int i, j, n, err = 0 ;
+    for (i = 0; i < rec_calls; i++) {
+        const ReplayCall *c = &rec_call[i] ;
+        if (c->count == 0) {
+            err |= vga_raster_pixel(r, c->x * sx_q1 / 2 + ox, c->y * sy_q1 / 2 + oy, c->color) ;
+            continue ;
+        }
+        for (j = 0; j < c->count; j += n) {
+            n = min(c->count - j, 256) ;
+            for (int k = 0; k < n; k++) {
+                const VgaSegment *s = &rec_seg[c->first + j + k] ;
+                scaled[k].x0 = s->x0 * sx_q1 / 2 + ox ;
+                scaled[k].y0 = s->y0 * sy_q1 / 2 + oy ;
+                scaled[k].x1 = s->x1 * sx_q1 / 2 + ox ;
+                scaled[k].y1 = s->y1 * sy_q1 / 2 + oy ;
+            }
+            err |= vga_raster_thick_segments(r, scaled, n, c->color, c->radius) ;
+        }
+    }
+    if (err) {
+        fprintf(stderr, "raster_replay_host: out of memory\n") ;
+        exit(2) ;
+    }
+}
+
+// A forest: the recording unscaled, once per 640x480 cell of the canvas,
+// each copy overlapping the last by RASTER_FOREST_OVERLAP pixels
+static int queue_forest(VgaRaster *r) {
+    int copies = 0 ;
+    for (int oy = 0; oy + 480 <= r->height; oy += 480 - RASTER_FOREST_OVERLAP) {
+        for (int ox = 0; ox + 640 <= r->width; ox += 640 - RASTER_FOREST_OVERLAP) {
+            queue_scene(r, 2, 2, ox, oy) ;
+            copies++ ;
+        }
+    }
+    return copies ;
+}
+
+static int render_serial(VgaRaster *r, int threads) {
+    (void)threads ;
+    vga_raster_render_serial(r) ;
+    return 0 ;
+}
+
+// Seconds for the fastest of reps renders, canvas cleared before each
+static double time_render(VgaRaster *r, int (*render)(VgaRaster *, int), int threads, int reps) {
+    size_t bytes = (size_t)r->row_bytes * r->height ;
+    double t0, t, best = 0 ;
+    for (int i = 0; i < reps; i++) {
+        memset(r->data, 0, bytes) ;
+        t0 = now_s() ;
+        if (render(r, threads)) {
+            fprintf(stderr, "raster_replay_host: out of memory\n") ;
+            exit(2) ;
+        }
+        t = now_s() - t0 ;
+        if (i == 0 || t < best) best = t ;
+    }
+    return best ;
+}
+
+// Render at width x height either the recording scaled from 640x480 by
+// sx_q1 / 2 and sy_q1 / 2 or, with sx_q1 0, a forest of it. Tiled renders
+// on 1 to 32 threads and vga_raster_render are each checked against the
+// serial render, and at 640x480 the serial render against fb_sum, the
+// framebuffer's checksum.
+static int scaling_report(int width, int height, int sx_q1, int sy_q1, int reps, unsigned long fb_sum) {
+    static const int threads[] = {1, 2, 4, 8, 16, 32} ;
+    VgaRaster r ;
+    unsigned char *serial ;
+    size_t bytes ;
+    double t_serial, t ;
+    int copies = 1, differs = 0 ;
+
+    if (vga_raster_init(&r, width, height, RASTER_TILE)) {
+        fprintf(stderr, "raster_replay_host: out of memory\n") ;
+        exit(2) ;
+    }
+    bytes = (size_t)r.row_bytes * height ;
+    if (sx_q1) queue_scene(&r, sx_q1, sy_q1, 0, 0) ;
+    else copies = queue_forest(&r) ;
+    t_serial = time_render(&r, render_serial, 0, reps) ;
+    serial = malloc(bytes) ;
+    if (serial == NULL) {
+        fprintf(stderr, "raster_replay_host: out of memory\n") ;
+        exit(2) ;
+    }
+    memcpy(serial, r.data, bytes) ;
+    if (width == 640 && height == 480) {
+        memcpy(vga_data_array, serial, TXCOUNT) ;
+        if (vga_host_checksum() != fb_sum) {
+            printf("%dx%d serial: checksum %08lx, framebuffer %08lx\n", width, height, vga_host_checksum(), fb_sum) ;
+            differs++ ;
+        }
+    }
+    printf("%dx%d, %s%d scene%s, %u commands per render, %dx%d tiles: serial %7.2f ms\n",
+           width, height, sx_q1 ? "scaled, " : "forest of ", copies, copies == 1 ? "" : "s",
+           r.count, r.tiles_x, r.tiles_y, 1e3 * t_serial) ;
+    for (unsigned int i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        t = time_render(&r, vga_raster_render_tiled, threads[i], reps) ;
+        if (memcmp(serial, r.data, bytes)) {
+            printf("%dx%d %2d threads: differs from serial\n", width, height, threads[i]) ;
+            differs++ ;
+        }
+        printf("  tiled, %2d threads %7.2f ms (%4.2fx)\n", threads[i], 1e3 * t, t_serial / t) ;
+    }
+    t = time_render(&r, vga_raster_render, 32, reps) ;
+    if (memcmp(serial, r.data, bytes)) {
+        printf("%dx%d vga_raster_render: differs from serial\n", width, height) ;
+        differs++ ;
+    }
+    printf("  vga_raster_render(32) %7.2f ms (%4.2fx), %s\n", 1e3 * t, t_serial / t,
+           r.count < VGA_RASTER_SERIAL_BELOW ? "serial, too few commands" :
+           sysconf(_SC_NPROCESSORS_ONLN) < 2 ? "serial, one core" : "tiled") ;
+    free(serial) ;
+    vga_raster_free(&r) ;
+    return differs ;
+}
+
+void host_scene_done(void) {
+    unsigned long fb_sum ;
+    int differs = 0 ;
+
+    if (++host_scene < replay_scene) {
+        // the next scene is drawn on a cleared screen
+        rec_calls = 0 ;
+        rec_segs = 0 ;
+        return ;
+    }
+    fflush(stdout) ;
+    memset(vga_data_array, 0, TXCOUNT) ;
+    for (int i = 0; i < rec_calls; i++) {
+        const ReplayCall *c = &rec_call[i] ;
+        if (c->count) drawThickSegments(&rec_seg[c->first], c->count, c->color, c->radius) ;
+        else drawPixel(c->x, c->y, c->color) ;
+    }
+    fb_sum = vga_host_checksum() ;
+    printf("scene %d: %d calls, %d segments, serial path checksum %08lx\n",
+           host_scene, rec_calls, rec_segs, fb_sum) ;
+    differs += scaling_report(640, 480, 2, 2, 50, fb_sum) ;
+    differs += scaling_report(RASTER_4K_W, RASTER_4K_H, 2 * RASTER_4K_W / 640, 2 * RASTER_4K_H / 480, 20, fb_sum) ;
+    differs += scaling_report(RASTER_4K_W, RASTER_4K_H, 0, 0, 5, fb_sum) ;
+    fflush(stdout) ;
+    exit(differs ? 1 : 0) ;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 || (argc > 1 && atoi(argv[1]) <= 0)) {
+        fprintf(stderr, "usage: %s [scene]\n", argv[0]) ;
+        return 2 ;
+    }
+    if (argc > 1) replay_scene = atoi(argv[1]) ;
+    return trees_demo_main() ;
+}
@@ -0,0 +1,159 @@
+/**
+ * Segments per second, batched against per-call, on the host
+ *
+ * Grows the demo's three tree species with its own L-system code (nextgen,
+ * and lsys_sort_by_depth to walk the turtle into segments), then times
+ * drawing each tree three ways: one drawLine call per segment, as the
+ * turtle used to, drawSegments in batches of LSYS_BATCH as it does now, and
+ * drawSegments over the whole tree in one call. Also checks that drawLine
+ * and drawSegments leave the same framebuffer. The tree is then drawn
+ * thick as the demo draws it with LSYS_THICK, one drawThickSegments call
+ * per depth with lsys_depth_radius, and timed against the thin one call:
+ *     make VGA_DIR=<VGA library dir> segments_bench_host
+ *     ./segments_bench_host
+ * Exits with status 1 if they differ, if the turtle's batches draw any
+ * tree slower than drawLine did, or if a thick tree costs more than
+ * THICK_MAX_COST times the thin one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define main trees_demo_main
+#include "trees_demo.c"
+#undef main
+
+#define TXCOUNT 153600
+extern unsigned char vga_data_array[] ;
+// Most a thick tree may cost, in times the thin one
+#define THICK_MAX_COST 2.0
+
+static unsigned char by_line[TXCOUNT] ;
+static VgaSegment segs[LSYS_MAX_SEGMENTS] ;
+
+static double now_s(void) {
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return t.tv_sec + t.tv_nsec * 1e-9 ;
+}
+
+static void draw_per_call(int count, char color) {
+    for (int i = 0; i < count; i++) drawLine(segs[i].x0, segs[i].y0, segs[i].x1, segs[i].y1, color) ;
+}
+
+static void draw_batched(int count, char color) {
+    for (int i = 0; i < count; i += LSYS_BATCH) drawSegments(&segs[i], min(LSYS_BATCH, count - i), color) ;
+}
+
+static void draw_whole(int count, char color) {
+    drawSegments(segs, count, color) ;
+}
+
+// segs is in lsys_order's order, sorted by depth
+static void draw_thick(int count, char color) {
+    int start = 0, end ;
+    for (int d = 0; d < LSYS_MAX_DEPTH && start < count; d++, start = end) {
+        end = min(lsys_depth_end[d], count) ;
+        drawThickSegments(&segs[start], end - start, color, d < LSYS_THICK_DEPTHS ? lsys_depth_radius[d] : 0) ;
+    }
+}
+
+// Draw the tree each of n ways in turns, 0.05 s per turn, ten turns
+// each. rate[i] is the best segments per second of draw[i]: the host's
+// other work only ever makes a turn slower, and taking turns gives every
+// way the same chances.
+static void time_draws(void (*const draw[])(int, char), int n, int count, double *rate) {
+    double start, elapsed ;
+    long trees ;
+    for (int i = 0; i < n; i++) rate[i] = 0 ;
+    for (int turn = 0; turn < 10; turn++) {
+        for (int i = 0; i < n; i++) {
+            start = now_s() ;
+            trees = 0 ;
+            do {
+                draw[i](count, (trees & 6) + 1) ;
+                trees++ ;
+                elapsed = now_s() - start ;
+            } while (elapsed < 0.05) ;
+            rate[i] = max(rate[i], trees * count / elapsed) ;
+        }
+    }
+}
+
+void host_scene_done(void) {
+}
+
+int main(void) {
+    static const struct { const char *name ; char *axiom ; Rule r1, r2 ; int rules, iterations, linelen ; } trees[] = {
+        {"a (F[+F]F[-F]F)", "F", {'F', "F[+F]F[-F]F", NULL}, {0, NULL, NULL}, 1, 4, 3},
+        {"d (F[+X]F[-X]+X)", "X", {'X', "F[+X]F[-X]+X", NULL}, {'F', "FF", NULL}, 2, 6, 2},
+        {"e (F[+X][-X]FX)", "X", {'X', "F[+X][-X]FX", NULL}, {'F', "FF", NULL}, 2, 6, 3},
+    } ;
+    Rule r1, r2 ;
+    uint32_t v ;
+    int count, same, differs = 0, slower = 0 ;
+    static void (*const draw[])(int, char) = {draw_per_call, draw_batched, draw_whole, draw_thick} ;
+    double rate[4], per_call, batched, whole, thick ;
+
+    initVGA() ;
+    curgen = malloc(10000) ;
+    for (unsigned t = 0; t < sizeof(trees) / sizeof(trees[0]); t++) {
+        r1 = trees[t].r1 ;
+        r2 = trees[t].r2 ;
+        r1.next = (trees[t].rules == 2) ? &r2 : NULL ;
+        ls->axiom = trees[t].axiom ;
+        ls->rules = &r1 ;
+        ls->linelen = trees[t].linelen ;
+        ls->leftangle = -30 ;
+        ls->rightangle = 30 ;
+        x_cur = 270 ;
+        y_cur = 420 ;
+        angle_cur = -90 ;
+        strcpy(curgen, ls->axiom) ;
+        for (int i = 0; i < trees[t].iterations; i++) nextgen() ;
+        count = lsys_sort_by_depth(curgen) ;
+        if (count <= 0) {
+            printf("tree %s: no segments\n", trees[t].name) ;
+            return 1 ;
+        }
+        for (int i = 0; i < count; i++) {
+            v = lsys_order[i] ;
+            segs[i].x0 = (int)(v & 0x7FF) - 512 ;
+            segs[i].y0 = (int)((v >> 11) & 0x7FF) - 512 ;
+            segs[i].x1 = segs[i].x0 + ((int32_t)(v << 5) >> 27) ;
+            segs[i].y1 = segs[i].y0 + ((int32_t)v >> 27) ;
+        }
+
+        memset(vga_data_array, 0, TXCOUNT) ;
+        draw_per_call(count, GREEN) ;
+        memcpy(by_line, vga_data_array, TXCOUNT) ;
+        memset(vga_data_array, 0, TXCOUNT) ;
+        draw_whole(count, GREEN) ;
+        same = (memcmp(by_line, vga_data_array, TXCOUNT) == 0) ;
+        if (!same) differs++ ;
+
+        time_draws(draw, 4, count, rate) ;
+        per_call = rate[0] ;
+        batched = rate[1] ;
+        whole = rate[2] ;
+        thick = rate[3] ;
+        printf("tree %-17s %4d segments: drawLine %5.2f M/s, batches of %d %5.2f M/s (%.1fx), "
+               "one call %5.2f M/s (%.1fx), pixels %s\n", trees[t].name, count, per_call / 1e6,
+               LSYS_BATCH, batched / 1e6, batched / per_call, whole / 1e6, whole / per_call,
+               same ? "identical" : "differ") ;
+        if (batched < per_call) {
+            printf("tree %s: batches of %d slower than drawLine\n", trees[t].name, LSYS_BATCH) ;
+            slower++ ;
+        }
+        printf("tree %-17s %4d segments: thick by depth (radius", trees[t].name, count) ;
+        for (int d = 0; d < LSYS_THICK_DEPTHS; d++) printf(" %d", lsys_depth_radius[d]) ;
+        printf(") %5.2f M/s, %.1fx the cost of one thin call\n", thick / 1e6, whole / thick) ;
+        if (whole / thick > THICK_MAX_COST) {
+            printf("tree %s: thick costs more than %.1fx thin\n", trees[t].name, THICK_MAX_COST) ;
+            slower++ ;
+        }
+    }
+    return (differs || slower) ? 1 : 0 ;
+}
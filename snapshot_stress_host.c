@@ -0,0 +1,133 @@
+/**
+ * Stress test for the audio feature seqlock, on the host
+ *
+ * A writer thread publishes AudioFeatures sets through trees_demo.c's own
+ * audio_snapshot_write, with every field derived from one counter. Reader
+ * threads copy sets out with audio_snapshot_read and check each one is
+ * whole. A control pass first reads with a plain copy instead, to show
+ * that the check does catch torn sets:
+ *     make VGA_DIR=<VGA library dir> snapshot_stress_host
+ *     ./snapshot_stress_host [seconds [readers]]
+ * Exits with status 1 if the seqlock ever hands out a torn set. With one
+ * CPU only preemption interleaves the threads, so run it on a multi-core
+ * box to exercise real concurrency.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define main trees_demo_main
+#include "trees_demo.c"
+#undef main
+
+#define MAX_READERS 16
+
+static volatile int stop ;
+static int locked ;                     // readers use audio_snapshot_read
+static unsigned long writes ;
+
+typedef struct {
+    pthread_t thread ;
+    unsigned long reads ;
+    unsigned long torn ;
+} Reader ;
+
+// The set published for counter k (floats stay exact below 2^24)
+static void fill(AudioFeatures *f, uint32_t k) {
+    float v = (float)(k & 0xFFFFFF) ;
+    int i ;
+    f->frame = k ;
+    f->peak_hz = v ;
+    f->centroid_hz = v + 1 ;
+    for (i = 0; i < AUDIO_BANDS; i++) f->band[i] = k + i ;
+    f->flux = k ;
+    f->rms = v + 2 ;
+    f->window_us = k ;
+    f->fft_us = k ;
+    f->freq_hz = v + 3 ;
+    f->time_us = k ;
+    f->onset = k ;
+    f->tempo_bpm = v + 4 ;
+    f->beat_period_us = k ;
+    f->beat_phase = (fix15)k ;
+    f->beat_count = k ;
+}
+
+static void *writer_main(void *arg) {
+    AudioFeatures f ;
+    uint32_t k = 0 ;
+    (void)arg ;
+    while (!stop) {
+        fill(&f, ++k) ;
+        audio_snapshot_write(&f) ;
+    }
+    writes = k ;
+    return NULL ;
+}
+
+static void *reader_main(void *arg) {
+    Reader *r = arg ;
+    AudioFeatures got, expect ;
+    while (!stop) {
+        if (locked) audio_snapshot_read(&got) ;
+        else {
+            __dmb() ;
+            memcpy(&got, (const void *)&audio_snapshot, sizeof(got)) ;
+        }
+        fill(&expect, got.frame) ;
+        if (memcmp(&got, &expect, sizeof(got)) != 0) r->torn++ ;
+        r->reads++ ;
+    }
+    return NULL ;
+}
+
+// Run one writer against readers threads for seconds, returns torn reads
+static unsigned long run(double seconds, int readers, const char *name) {
+    static Reader reader[MAX_READERS] ;
+    struct timespec t = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)} ;
+    pthread_t writer ;
+    AudioFeatures first ;
+    unsigned long reads = 0, torn = 0 ;
+    int i ;
+
+    fill(&first, 0) ;
+    audio_snapshot_write(&first) ;
+    stop = 0 ;
+    memset(reader, 0, sizeof(reader)) ;
+    pthread_create(&writer, NULL, writer_main, NULL) ;
+    for (i = 0; i < readers; i++) pthread_create(&reader[i].thread, NULL, reader_main, &reader[i]) ;
+    nanosleep(&t, NULL) ;
+    stop = 1 ;
+    pthread_join(writer, NULL) ;
+    for (i = 0; i < readers; i++) {
+        pthread_join(reader[i].thread, NULL) ;
+        reads += reader[i].reads ;
+        torn += reader[i].torn ;
+    }
+    printf("%-13s %lu torn of %lu reads, %lu writes\n", name, torn, reads, writes) ;
+    return torn ;
+}
+
+void host_scene_done(void) {
+}
+
+int main(int argc, char **argv) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 2.0 ;
+    int readers = (argc > 2) ? atoi(argv[2]) : 2 ;
+    unsigned long torn ;
+
+    if (seconds <= 0 || readers < 1 || readers > MAX_READERS) {
+        fprintf(stderr, "usage: %s [seconds [readers (1-%d)]]\n", argv[0], MAX_READERS) ;
+        return 2 ;
+    }
+    locked = 0 ;
+    if (run(seconds / 2, readers, "plain copy:") == 0) {
+        printf("(the plain copy never tore, so this run says little about the seqlock)\n") ;
+    }
+    locked = 1 ;
+    torn = run(seconds, readers, "seqlock:") ;
+    return torn ? 1 : 0 ;
+}
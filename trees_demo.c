@@ -15,6 +15,22 @@
  *  - GPIO 20 ---> 330 ohm resistor ---> VGA Blue
  *  - RP2040 GND ---> VGA GND
  *
+ *  COMPILE-TIME SWITCHES (each #define sits next to the code it selects)
+ *  Looks, off by default so the firmware shows the original scene:
+ *  - FERN_DENSITY_MODE   1: log-density shaded fern, 0: one GREEN pixel per point
+ *  - LSYS_THICK          1: branches get thinner with bracket depth
+ *  - LSYS_DEPTH_ORDER    1: trees grow breadth first, by bracket depth
+ *  - GROWTH_ON_BEAT      1: growth steps on the beat once a tempo locks
+ *  - FFT_AUTO_SIZE       1: FFT length follows the pitch
+ *  - AUDIO_GOERTZEL      1: Goertzel bank instead of the FFT peak search
+ *  - DISPLAY_LIST        1: record each scene and redraw it from the record
+ *  Speed only, on by default:
+ *  - REAL_FFT            real-input FFT
+ *  - FFT_RADIX4          radix-4 FFT kernel
+ *  - FERN_CONST_KERNELS  constant-coefficient fern maps
+ *  - LSYS_BATCH          turtle segments per drawThickSegments call (4)
+ *  Tuning: FFT_HOP_SHIFT (frame overlap), AUDIO_FEATURES (features computed)
+ *
  *  REFERENCES:
  *  Microphone FFT, Barnsley Fern: https://github.com/vha3/Hunter-Adams-RP2040-Demos
  *  L-System Impelementaion: https://github.com/telephil9/lsystem/blob/master/lsystem.c
@@ -23,11 +39,19 @@
 
 // Include the VGA grahics library
 #include "vga_graphics.h"
+// Batched segment drawing
+#include "vga_fast.h"
+#include "vga_record.h"
+#include "vga_hud.h"
 // Include standard libraries
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#ifdef VGA_HOST
+// Host build: the SDK and protothreads come from pico_host.c
+#include "pico_host.h"
+#else
 // Include Pico libraries
 #include "pico/stdlib.h"
 #include "pico/divider.h"
@@ -39,8 +63,10 @@
 #include "hardware/irq.h"
 #include "hardware/clocks.h"
 #include "hardware/pll.h"
+#include "hardware/sync.h"
 // Include protothreads
 #include "pt_cornell_rp2040_v1.h"
+#endif
 
 // === the fixed point macros ========================================
 typedef signed int fix15 ;
@@ -59,14 +85,18 @@ typedef signed int fix15 ;
 // ADC Channel and pin
 #define ADC_CHAN 0
 #define ADC_PIN 26
+// Log2 of the largest FFT (sizes the sample buffers and tables). Every
+// other size constant follows from it (10..12, 11 or 12 give 2048/4096 points
+// if the RAM can be spared).
+#define LOG2_NUM_SAMPLES 10
+// Log2 of the smallest FFT the audio thread may switch to
+#define FFT_LOG2_MIN 6
 // Number of samples per FFT
-#define NUM_SAMPLES 1024
+#define NUM_SAMPLES (1 << LOG2_NUM_SAMPLES)
 // Number of samples per FFT, minus 1
-#define NUM_SAMPLES_M_1 1023
-// Length of short (16 bits) minus log2 number of samples (10)
-#define SHIFT_AMOUNT 6
-// Log2 number of samples
-#define LOG2_NUM_SAMPLES 10
+#define NUM_SAMPLES_M_1 (NUM_SAMPLES - 1)
+// Length of short (16 bits) minus log2 number of samples
+#define SHIFT_AMOUNT (16 - LOG2_NUM_SAMPLES)
 // Sample rate (Hz)
 #define Fs 10000.0
 // ADC clock rate (unmutable!)
@@ -83,29 +113,371 @@ int control_chan = 3 ;
 // 0.4 in fixed point (used for alpha max plus beta min)
 fix15 zero_point_4 = float2fix15(0.4) ;
 
-// Here's where we'll have the DMA channel put ADC samples
-uint8_t sample_array[NUM_SAMPLES] ;
+// Here's where we'll have the DMA channel put ADC samples. The sample
+// channel free-runs around this buffer as a ring (DMA write address wrap)
+// and chains back to the control channel, so no audio is lost while a
+// frame is windowed and transformed. Each frame is the latest fft_len
+// samples, taken every hop samples, so consecutive frames overlap.
+// Twice the largest frame, so a full frame stays intact behind the DMA
+#define CAPTURE_LOG2 (LOG2_NUM_SAMPLES + 1)
+#define CAPTURE_LEN (1 << CAPTURE_LOG2)
+#define CAPTURE_MASK (CAPTURE_LEN - 1)
+// Hop = frame length >> FFT_HOP_SHIFT (1: 50% overlap, 2: 75% overlap)
+#define FFT_HOP_SHIFT 1
+// Samples the DMA may write into a frame's span before it is copied out
+#define CAPTURE_MARGIN 64
+// Transfer count of the free-running sample channel (~5 days at 10 kHz)
+#define CAPTURE_COUNT 0xFFFFFFFFu
+uint8_t sample_array[CAPTURE_LEN] __attribute__((aligned(CAPTURE_LEN))) ;
+// Total samples written so far by the sample channel
+#define samples_captured() (CAPTURE_COUNT - dma_hw->ch[sample_chan].transfer_count)
+// Frames dropped because analysis fell a whole ring behind the capture
+uint32_t fft_overruns = 0 ;
+// Time spent analyzing the last audio frame (FFT or Goertzel path)
+volatile uint32_t audio_frame_us = 0 ;
 // And here's where we'll copy those samples for FFT calculation
 fix15 fr[NUM_SAMPLES] ;
 fix15 fi[NUM_SAMPLES] ;
 
-// Sine table for the FFT calculation
-fix15 Sinewave[NUM_SAMPLES]; 
-// Hann window table for FFT calculation
-fix15 window[NUM_SAMPLES]; 
+// Quarter-wave sine table for the FFT calculation, shared by every FFT
+// size: sin(2pi j/NUM_SAMPLES) for j = 0..NUM_SAMPLES/4. The rest of the
+// period comes from symmetry in fft_sin.
+fix15 Sinewave[NUM_SAMPLES/4 + 1]; 
+// sin(2pi j/NUM_SAMPLES) for any j
+static inline fix15 fft_sin(int j) {
+    j &= NUM_SAMPLES_M_1 ;
+    if (j < NUM_SAMPLES/2) {
+        return (j <= NUM_SAMPLES/4) ? Sinewave[j] : Sinewave[NUM_SAMPLES/2 - j] ;
+    }
+    j -= NUM_SAMPLES/2 ;
+    return -((j <= NUM_SAMPLES/4) ? Sinewave[j] : Sinewave[NUM_SAMPLES/2 - j]) ;
+}
+#define fft_cos(j) fft_sin((j) + NUM_SAMPLES/4)
+// Hann window value j/N of the way through the frame, from the sine table
+#define hann(j) ((int2fix15(1) - fft_cos(j)) >> 1)
 volatile float max_freqency;
 
+// Frequency bands of the sleeptime ladders, upper edges in Hz (the last
+// band is everything above 1500 Hz)
+#define AUDIO_BANDS 7
+const float audio_band_edges[AUDIO_BANDS-1] = {100.0, 200.0, 400.0, 800.0, 1000.0, 1500.0} ;
+
+// Results of each frame's magnitude pass, which the last FFT stage runs
+fix15 fft_peak_mag ;                // largest magnitude above the cutoff
+int fft_peak_dex ;                  // its bin, 0 if nothing cleared the threshold
+int fft_peak_min_dex ;              // bins at or below this are ignored (DC leakage)
+int fft_band_last[AUDIO_BANDS] ;    // highest bin of each band at the frame's length
+uint32_t fft_band_sum[AUDIO_BANDS] ; // summed magnitudes of each band
+uint64_t fft_centroid_acc ;         // sum of bin * (magnitude >> 4)
+uint32_t fft_flux_acc ;             // summed magnitude increases since the last frame
+fix15 fft_prev_mag[NUM_SAMPLES/2] ; // last frame's magnitudes, for the flux
+int fft_prev_log2 = 0 ;             // length of the frame in fft_prev_mag
+
+// Features the magnitude pass accumulates, as a bitmask. Leaving one out
+// removes its work from the pass at compile time.
+#define FEAT_PEAK     1
+#define FEAT_BANDS    2
+#define FEAT_CENTROID 4
+#define FEAT_FLUX     8
+#define FEAT_MAG      16    // magnitudes only, implied by the others
+#define AUDIO_FEATURES (FEAT_PEAK | FEAT_BANDS | FEAT_CENTROID | FEAT_FLUX)
+
+// Everything the scene may read about the latest audio frame
+typedef struct {
+    uint32_t frame ;                // frames analyzed so far
+    float peak_hz ;                 // strongest bin, 0 if nothing cleared the threshold
+    float centroid_hz ;             // magnitude-weighted mean frequency
+    uint32_t band[AUDIO_BANDS] ;    // summed magnitudes per ladder band
+    uint32_t flux ;                 // onset strength: summed magnitude increases
+    float rms ;                     // loudness in ADC counts, bias removed
+    uint32_t window_us ;            // time in the front end (window, sort, RMS)
+    uint32_t fft_us ;               // time in the FFT and magnitude/feature pass
+    float freq_hz ;                 // max_freqency: peak averaged over 3 frames
+    uint32_t time_us ;              // time_us_32 when the set was published
+    uint32_t onset ;                // onset strength of this frame (0..4095)
+    float tempo_bpm ;               // 0 until a tempo is locked
+    uint32_t beat_period_us ;       // 0 until a tempo is locked
+    fix15 beat_phase ;              // at time_us: 0 on the beat, climbing to 1
+    uint32_t beat_count ;           // beats since boot
+} AudioFeatures ;
+AudioFeatures audio_features ;
+// Nanoseconds per bin of the magnitude pass alone, then of each feature on
+// top of it (peak, bands, centroid, flux), measured at boot
+float audio_feature_ns[5] ;
+
+// ---- Feature snapshot channel ----
+// Seqlock between protothread_fft (the only writer, core 1) and readers on
+// either core. The writer never waits. A reader that overlaps a write
+// retries, so it always gets one frame's complete set.
+volatile uint32_t audio_seq = 0 ;   // odd while a write is in progress
+AudioFeatures audio_snapshot ;
+
+void audio_snapshot_write(const AudioFeatures *f) {
+    audio_seq++ ;
+    __dmb() ;
+    audio_snapshot = *f ;
+    __dmb() ;
+    audio_seq++ ;
+}
+
+// Copy the latest published set into f
+void audio_snapshot_read(AudioFeatures *f) {
+    uint32_t seq ;
+    do {
+        seq = audio_seq ;
+        __dmb() ;
+        *f = audio_snapshot ;
+        __dmb() ;
+    } while ((seq & 1) || seq != audio_seq) ;
+}
+
+// ---- Onset and tempo tracker ----
+// The flux of each frame, less its slow average, is the onset strength.
+// It is resampled onto a fixed grid of ticks (frame hops vary with the
+// auto-sizer). A decaying autocorrelation over the lags of 60-180 BPM picks
+// the beat period. A phase accumulator runs at that period and is pulled
+// toward strong onsets. Each tick costs about TEMPO_LAG_MAX multiply-adds.
+// 256-sample ticks (25.6 ms at 10 kHz)
+#define TEMPO_TICK_LOG2 8
+#define TEMPO_TICK (1 << TEMPO_TICK_LOG2)
+// Lags searched, in ticks: 180 BPM down to 60 BPM
+#define TEMPO_LAG_MIN 13
+#define TEMPO_LAG_MAX 39
+// Onset history, a power of two above TEMPO_LAG_MAX
+#define TEMPO_HIST 64
+// Autocorrelation decays by 1/64 per tick (time constant ~1.6 s)
+#define TEMPO_DECAY_SHIFT 6
+// Period autocorrelation needed, relative to lag 0, to report a tempo
+#define TEMPO_LOCK float2fix15(0.25)
+uint32_t tempo_env[TEMPO_HIST] ;            // onset strength per tick
+uint32_t tempo_acf[TEMPO_LAG_MAX + 3] ;     // decaying autocorrelation per lag
+uint32_t tempo_ticks = 0 ;                  // ticks so far
+uint32_t tempo_next_tick = TEMPO_TICK ;     // capture index that ends the current tick
+uint32_t tempo_pending = 0 ;                // strongest onset in the current tick
+uint32_t onset_mean = 0 ;                   // slow average of the flux
+uint32_t onset_avg = 0 ;                    // slow average of the onset strength
+float beat_lag = TEMPO_LAG_MAX ;            // beat period in ticks
+fix15 beat_phase = 0 ;                      // 0 on the beat, climbing to 1
+uint32_t beat_count = 0 ;                   // beats since boot
+
+// Advance the tracker by one tick with onset strength o
+void tempo_tick(uint32_t o) {
+    int lag, best ;
+    uint32_t old ;
+    float num, den ;
+
+    tempo_env[tempo_ticks & (TEMPO_HIST-1)] = o ;
+    best = TEMPO_LAG_MIN ;
+    for (lag = 0; lag <= TEMPO_LAG_MAX + 2; lag++) {
+        if (lag > 0 && lag < TEMPO_LAG_MIN - 2) continue ;
+        old = tempo_env[(tempo_ticks - lag) & (TEMPO_HIST-1)] ;
+        tempo_acf[lag] += o * old - (tempo_acf[lag] >> TEMPO_DECAY_SHIFT) ;
+        if (lag >= TEMPO_LAG_MIN && lag <= TEMPO_LAG_MAX && tempo_acf[lag] > tempo_acf[best]) best = lag ;
+    }
+    tempo_ticks++ ;
+
+    // refine the period between ticks with the centroid around the peak
+    // (onsets only land on frame ends, so the peak is spread over lags)
+    num = 0 ;
+    den = 0 ;
+    for (lag = best - 2; lag <= best + 2; lag++) {
+        num += (float)lag * tempo_acf[lag] ;
+        den += tempo_acf[lag] ;
+    }
+    beat_lag = (den > 0) ? num / den : best ;
+
+    // run the phase at the beat period, and pull it toward strong onsets
+    beat_phase += (fix15)(32768.0 / beat_lag) ;
+    if (o > 2 * onset_avg && o > 0) {
+        if (beat_phase < int2fix15(1) / 2) beat_phase -= beat_phase >> 2 ;
+        else beat_phase += (int2fix15(1) - beat_phase) >> 2 ;
+    }
+    if (beat_phase >= int2fix15(1)) {
+        beat_phase -= int2fix15(1) ;
+        beat_count++ ;
+    }
+    onset_avg += ((int32_t)o - (int32_t)onset_avg) >> 4 ;
+}
+
+// Feed the flux of the frame ending at capture index frame_end, and copy
+// the tracker's state into audio_features
+void tempo_update(uint32_t flux, uint32_t frame_end) {
+    uint32_t o ;
+
+    // onset strength, 12 bits so the autocorrelation fits in 32
+    o = (flux > onset_mean) ? (flux - onset_mean) >> 10 : 0 ;
+    o = min(o, 4095) ;
+    onset_mean += ((int32_t)flux - (int32_t)onset_mean) >> 4 ;
+    // short frames share a tick (keep the strongest), a long hop fills
+    // every tick it spans so the autocorrelation stays smooth across lags
+    tempo_pending = max(tempo_pending, o) ;
+    if ((int32_t)(frame_end - tempo_next_tick) >= 0) {
+        do {
+            tempo_tick(tempo_pending) ;
+            tempo_pending = o ;
+            tempo_next_tick += TEMPO_TICK ;
+        } while ((int32_t)(frame_end - tempo_next_tick) >= 0) ;
+        tempo_pending = 0 ;
+    }
+
+    audio_features.onset = o ;
+    audio_features.beat_phase = beat_phase ;
+    audio_features.beat_count = beat_count ;
+    if (tempo_acf[0] && (uint64_t)tempo_acf[(int)(beat_lag + 0.5)] << 15 > (uint64_t)tempo_acf[0] * TEMPO_LOCK) {
+        audio_features.beat_period_us = (uint32_t)(beat_lag * TEMPO_TICK * 1000000.0 / Fs) ;
+        audio_features.tempo_bpm = 60.0 * Fs / (beat_lag * TEMPO_TICK) ;
+    }
+    else {
+        audio_features.beat_period_us = 0 ;
+        audio_features.tempo_bpm = 0.0 ;
+    }
+}
+
+// 1: once a tempo is locked, the L-system draws its segments on a grid of
+// LSYS_SEGMENTS_PER_BEAT per beat instead of the frequency ladder
+#define GROWTH_ON_BEAT 0
+#define LSYS_SEGMENTS_PER_BEAT 8
+// Segment batches per beat (see LSYS_BATCH)
+#define LSYS_SLOTS_PER_BEAT (LSYS_SEGMENTS_PER_BEAT / LSYS_BATCH)
+
+// Beat phase of snapshot f carried forward to time now (fix15, 0 on the
+// beat). 0 if no tempo is locked.
+fix15 beat_phase_at(const AudioFeatures *f, uint32_t now) {
+    uint32_t rem ;
+    if (!f->beat_period_us) return 0 ;
+    rem = (now - f->time_us) % f->beat_period_us ;
+    return (f->beat_phase + (fix15)(((rem >> 4) << 15) / (f->beat_period_us >> 4))) & 0x7FFF ;
+}
+// Log2 length of the frame being captured/analyzed, and of the next one
+int fft_log2 = LOG2_NUM_SAMPLES ;
+volatile int fft_log2_next = LOG2_NUM_SAMPLES ;
+// 1: choose the next FFT size from the detected pitch, 0: every frame is
+// NUM_SAMPLES long
+#define FFT_AUTO_SIZE 0
+
+// 1: real-input FFT (half size transform + split), 0: full complex FFTfix
+#define REAL_FFT 1
+
 // Pointer to address of start of sample buffer
 uint8_t * sample_address_pointer = &sample_array[0] ;
 
-// Peforms an in-place FFT. For more information about how this
-// algorithm works, please see https://vanhunteradams.com/FFT/FFT.html
-void FFTfix(fix15 fr[], fix15 fi[]) {
-    
-    unsigned short m;   // one of the indices being swapped
-    unsigned short mr ; // the other index being swapped (r for reversed)
-    fix15 tr, ti ; // for temporary storage while swapping, and during iteration
-    
+// Fill the shared sine table, once at boot
+void FFTfix_init_tables(void) {
+    int ii;
+    for (ii = 0; ii <= NUM_SAMPLES/4; ii++) {
+        Sinewave[ii] = float2fix15(sin(2.0 * PI * ((float) ii) / (float)NUM_SAMPLES));
+    }
+}
+
+// 1: radix-4 Danielson-Lanczos passes, 0: original radix-2 stages
+#define FFT_RADIX4 1
+
+// Radix-4 Danielson-Lanczos passes over bit-reversed data. Each pass merges
+// the four length-L FFTs at i, i+L, i+2L, i+3L into one of length 4L, doing
+// the work of two radix-2 stages with 3 complex multiplies instead of 4.
+// Every pass divides by four, the same as two halving radix-2 stages, so
+// the output is still scaled by 1/length. An odd number of stages starts
+// with one multiply-free radix-2 pass.
+static inline __attribute__((always_inline))
+void FFTfix_radix4(fix15 fr[], fix15 fi[], int log2_len) {
+
+    int i, m, j ;
+    int L ;        // length of the FFT's being combined
+    int k ;        // sine table index shift for the twiddles of this pass
+    int len = 1 << log2_len ;
+
+    fix15 w1r, w1i, w2r, w2i, w3r, w3i ; // W^m, W^2m, W^3m with W = e^(-2pi i/4L)
+    fix15 ar, ai, br, bi, cr, ci, dr, di ; // scaled and twiddled inputs
+    fix15 sr, si, tr, ti, ur, ui, vr, vi ; // partial sums
+
+    L = 1 ;
+    k = LOG2_NUM_SAMPLES - 2 ;
+    if (log2_len & 1) {
+        for (i=0; i<len; i+=2) {
+            ar = fr[i]>>1 ;
+            ai = fi[i]>>1 ;
+            br = fr[i+1]>>1 ;
+            bi = fi[i+1]>>1 ;
+            fr[i] = ar + br ;
+            fi[i] = ai + bi ;
+            fr[i+1] = ar - br ;
+            fi[i+1] = ai - bi ;
+        }
+        L = 2 ;
+        --k ;
+    }
+    while (L < len) {
+        for (m=0; m<L; ++m) {
+            // m << k < NUM_SAMPLES/4, so none of these lookups wrap
+            j = m << k ;
+            w1r =  fft_cos(j) ;
+            w1i = -fft_sin(j) ;
+            w2r =  fft_cos(2*j) ;
+            w2i = -fft_sin(2*j) ;
+            w3r =  fft_cos(3*j) ;
+            w3i = -fft_sin(3*j) ;
+            for (i=m; i<len; i+=(L<<2)) {
+                ar = fr[i]>>2 ;
+                ai = fi[i]>>2 ;
+                if (m == 0) {
+                    // all twiddles are 1
+                    br = fr[i+L]>>2 ;
+                    bi = fi[i+L]>>2 ;
+                    cr = fr[i+2*L]>>2 ;
+                    ci = fi[i+2*L]>>2 ;
+                    dr = fr[i+3*L]>>2 ;
+                    di = fi[i+3*L]>>2 ;
+                }
+                else {
+                    // bit-reversed order: i+L holds the W^2m term, i+2L the W^m term
+                    br = (multfix15(w2r, fr[i+L]) - multfix15(w2i, fi[i+L]))>>2 ;
+                    bi = (multfix15(w2r, fi[i+L]) + multfix15(w2i, fr[i+L]))>>2 ;
+                    cr = (multfix15(w1r, fr[i+2*L]) - multfix15(w1i, fi[i+2*L]))>>2 ;
+                    ci = (multfix15(w1r, fi[i+2*L]) + multfix15(w1i, fr[i+2*L]))>>2 ;
+                    dr = (multfix15(w3r, fr[i+3*L]) - multfix15(w3i, fi[i+3*L]))>>2 ;
+                    di = (multfix15(w3r, fi[i+3*L]) + multfix15(w3i, fr[i+3*L]))>>2 ;
+                }
+                sr = ar + br ;  si = ai + bi ;
+                tr = ar - br ;  ti = ai - bi ;
+                ur = cr + dr ;  ui = ci + di ;
+                vr = cr - dr ;  vi = ci - di ;
+                fr[i]     = sr + ur ;
+                fi[i]     = si + ui ;
+                fr[i+L]   = tr + vi ;   // (a - b) - i(c - d)
+                fi[i+L]   = ti - vr ;
+                fr[i+2*L] = sr - ur ;
+                fi[i+2*L] = si - ui ;
+                fr[i+3*L] = tr - vi ;   // (a - b) + i(c - d)
+                fi[i+3*L] = ti + vr ;
+            }
+        }
+        k -= 2 ;
+        L <<= 2 ;
+    }
+}
+
+// Next value of a bit-reversed counter whose most significant bit is top.
+// Lets the front end write samples straight into bit-reversed order.
+static inline int bitrev_next(int r, int top) {
+    while (r & top) {
+        r ^= top ;
+        top >>= 1 ;
+    }
+    return r | top ;
+}
+
+// The Danielson-Lanczos part of an in-place FFT of length 2^log2_len, on
+// data that is already in bit-reversed order. Each stage halves the data,
+// so the output is scaled by 1/length.
+static inline __attribute__((always_inline))
+void FFTfix_sorted_len(fix15 fr[], fix15 fi[], int log2_len) {
+
+#if FFT_RADIX4
+    FFTfix_radix4(fr, fi, log2_len) ;
+#else
+    fix15 tr, ti ; // temporary storage during iteration
+
+    int m ;    // element of the FFT's being combined
     int i, j ; // indices being combined in Danielson-Lanczos part of the algorithm
     int L ;    // length of the FFT's being combined
     int k ;    // used for looking up trig values from sine table
@@ -114,33 +486,9 @@ void FFTfix(fix15 fr[], fix15 fi[]) {
     
     fix15 wr, wi ; // trigonometric values from lookup table
     fix15 qr, qi ; // temporary variables used during DL part of the algorithm
-    
-    //////////////////////////////////////////////////////////////////////////
-    ////////////////////////// BIT REVERSAL //////////////////////////////////
-    //////////////////////////////////////////////////////////////////////////
-    // Bit reversal code below based on that found here:
-    // https://graphics.stanford.edu/~seander/bithacks.html#BitReverseObvious
-    for (m=1; m<NUM_SAMPLES_M_1; m++) {
-        // swap odd and even bits
-        mr = ((m >> 1) & 0x5555) | ((m & 0x5555) << 1);
-        // swap consecutive pairs
-        mr = ((mr >> 2) & 0x3333) | ((mr & 0x3333) << 2);
-        // swap nibbles ...
-        mr = ((mr >> 4) & 0x0F0F) | ((mr & 0x0F0F) << 4);
-        // swap bytes
-        mr = ((mr >> 8) & 0x00FF) | ((mr & 0x00FF) << 8);
-        // shift down mr
-        mr >>= SHIFT_AMOUNT ;
-        // don't swap that which has already been swapped
-        if (mr<=m) continue ;
-        // swap the bit-reveresed indices
-        tr = fr[m] ;
-        fr[m] = fr[mr] ;
-        fr[mr] = tr ;
-        ti = fi[m] ;
-        fi[m] = fi[mr] ;
-        fi[mr] = ti ;
-    }
+
+    int len = 1 << log2_len ; // number of points in this transform
+
     //////////////////////////////////////////////////////////////////////////
     ////////////////////////// Danielson-Lanczos //////////////////////////////
     //////////////////////////////////////////////////////////////////////////
@@ -148,23 +496,23 @@ void FFTfix(fix15 fr[], fix15 fi[]) {
     // Tom Roberts 11/8/89 and Malcolm Slaney 12/15/94 malcolm@interval.com
     // Length of the FFT's being combined (starts at 1)
     L = 1 ;
-    // Log2 of number of samples, minus 1
+    // Log2 of sine table length, minus 1 (shorter transforms stride further)
     k = LOG2_NUM_SAMPLES - 1 ;
     // While the length of the FFT's being combined is less than the number
     // of gathered samples . . .
-    while (L < NUM_SAMPLES) {
+    while (L < len) {
         // Determine the length of the FFT which will result from combining two FFT's
         istep = L<<1 ;
         // For each element in the FFT's that are being combined . . .
         for (m=0; m<L; ++m) {
             // Lookup the trig values for that element
             j = m << k ;                         // index of the sine table
-            wr =  Sinewave[j + NUM_SAMPLES/4] ; // cos(2pi m/N)
-            wi = -Sinewave[j] ;                 // sin(2pi m/N)
+            wr =  fft_cos(j) ;                  // cos(2pi m/N)
+            wi = -fft_sin(j) ;                  // sin(2pi m/N)
             wr >>= 1 ;                          // divide by two
             wi >>= 1 ;                          // divide by two
             // i gets the index of one of the FFT elements being combined
-            for (i=m; i<NUM_SAMPLES; i+=istep) {
+            for (i=m; i<len; i+=istep) {
                 // j gets the index of the FFT element being combined with i
                 j = i + L ;
                 // compute the trig terms (bottom half of the above matrix)
@@ -183,6 +531,423 @@ void FFTfix(fix15 fr[], fix15 fi[]) {
         --k ;
         L = istep ;
     }
+#endif
+}
+
+// Peforms an in-place FFT of length 2^log2_len (at most NUM_SAMPLES).
+// Each stage halves the data, so the output is scaled by 1/length.
+// Always inlined so each size in the kernel family below is compiled with
+// a constant length. For more information about how this
+// algorithm works, please see https://vanhunteradams.com/FFT/FFT.html
+static inline __attribute__((always_inline))
+void FFTfix_len(fix15 fr[], fix15 fi[], int log2_len) {
+    
+    unsigned short m;   // one of the indices being swapped
+    unsigned short mr ; // the other index being swapped (r for reversed)
+    fix15 tr, ti ; // for temporary storage while swapping
+    int len = 1 << log2_len ;
+    
+    //////////////////////////////////////////////////////////////////////////
+    ////////////////////////// BIT REVERSAL //////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////
+    // Bit reversal code below based on that found here:
+    // https://graphics.stanford.edu/~seander/bithacks.html#BitReverseObvious
+    for (m=1; m<len-1; m++) {
+        // swap odd and even bits
+        mr = ((m >> 1) & 0x5555) | ((m & 0x5555) << 1);
+        // swap consecutive pairs
+        mr = ((mr >> 2) & 0x3333) | ((mr & 0x3333) << 2);
+        // swap nibbles ...
+        mr = ((mr >> 4) & 0x0F0F) | ((mr & 0x0F0F) << 4);
+        // swap bytes
+        mr = ((mr >> 8) & 0x00FF) | ((mr & 0x00FF) << 8);
+        // shift down mr
+        mr >>= 16 - log2_len ;
+        // don't swap that which has already been swapped
+        if (mr<=m) continue ;
+        // swap the bit-reveresed indices
+        tr = fr[m] ;
+        fr[m] = fr[mr] ;
+        fr[mr] = tr ;
+        ti = fi[m] ;
+        fi[m] = fi[mr] ;
+        fi[mr] = ti ;
+    }
+    FFTfix_sorted_len(fr, fi, log2_len) ;
+}
+
+// Magnitude (alpha max plus beta min) of bin i. Also accumulates the
+// features selected in the (compile-time constant) features mask, so no
+// separate pass over the spectrum is needed.
+static inline __attribute__((always_inline))
+fix15 fft_bin(int i, fix15 re, fix15 im, int band, int features) {
+    fix15 mag, rise ;
+    re = abs(re) ;
+    im = abs(im) ;
+    mag = max(re, im) + multfix15(min(re, im), zero_point_4) ;
+    if (i > fft_peak_min_dex) {
+        if (features & FEAT_BANDS) fft_band_sum[band] += mag ;
+        if (features & FEAT_CENTROID) fft_centroid_acc += (uint32_t)i * (uint32_t)(mag >> 4) ;
+        if (features & FEAT_FLUX) {
+            rise = mag - fft_prev_mag[i] ;
+            if (rise > 0) fft_flux_acc += rise ;
+            fft_prev_mag[i] = mag ;
+        }
+        if ((features & FEAT_PEAK) && mag > fft_peak_mag && mag > 15000) {
+            fft_peak_mag = mag ;
+            fft_peak_dex = i ;
+        }
+    }
+    return mag ;
+}
+
+// Clear the peak and band sums and place the band edges for a 2^log2_len
+// point frame, ahead of its magnitude pass
+void fft_frame_reset(int log2_len) {
+    int b ;
+    int len = 1 << log2_len ;
+    fft_peak_mag = 0 ;
+    fft_peak_dex = 0 ;
+    fft_peak_min_dex = len >> 8 ;
+    for (b = 0; b < AUDIO_BANDS-1; b++) {
+        fft_band_last[b] = (int)(audio_band_edges[b] * len / Fs) ;
+        fft_band_sum[b] = 0 ;
+    }
+    fft_band_last[AUDIO_BANDS-1] = len ;
+    fft_band_sum[AUDIO_BANDS-1] = 0 ;
+    fft_centroid_acc = 0 ;
+    fft_flux_acc = 0 ;
+}
+
+// Magnitudes of bins 0..len/2-1 of a complex transform into fr, in one pass
+static inline __attribute__((always_inline))
+void FFTfix_magnitudes(fix15 fr[], fix15 fi[], int log2_len, int features) {
+    int i ;
+    int band = 0 ;
+    for (i = 0; i < (1 << (log2_len - 1)); i++) {
+        while (i > fft_band_last[band]) band++ ;
+        fr[i] = fft_bin(i, fr[i], fi[i], band, features) ;
+    }
+}
+
+// Split step of the real-input FFT: turns the half size spectrum of the
+// packed samples into bins 0..len/2-1. With a nonzero features mask (a
+// compile-time constant) it is also the magnitude pass, leaving magnitudes
+// in fr and accumulating those features (see fft_bin).
+static inline __attribute__((always_inline))
+void FFTfix_real_split(fix15 fr[], fix15 fi[], int log2_len, int features) {
+
+    int k, j ;     // bin and its mirror in the half size spectrum
+    int bk, bj ;   // bands of k and j
+    fix15 er, ei ; // spectrum of the even samples
+    fix15 or, oi ; // spectrum of the odd samples
+    fix15 wr, wi ; // trigonometric values from lookup table
+    fix15 tr, ti ; // twiddled odd spectrum
+    int len = 1 << log2_len ;
+    int stride = NUM_SAMPLES >> log2_len ; // sine table step for this length
+
+    // DC: even and odd sums are both real
+    fr[0] = (fr[0] + fi[0]) >> 1 ;
+    fi[0] = 0 ;
+    if (features) fr[0] = fft_bin(0, fr[0], 0, 0, features) ;
+    bk = 0 ;
+    bj = AUDIO_BANDS - 1 ;
+    // Split Z[k], Z[len/2-k] into the even/odd spectra, then twiddle
+    for (k=1; k<=(len>>2); k++) {
+        j = (len>>1) - k ;
+        er = (fr[k] + fr[j]) >> 1 ;
+        ei = (fi[k] - fi[j]) >> 1 ;
+        or = (fi[k] + fi[j]) >> 1 ;
+        oi = (fr[j] - fr[k]) >> 1 ;
+        wr =  fft_cos(k*stride) ;                  // cos(2pi k/len)
+        wi = -fft_sin(k*stride) ;                  // sin(2pi k/len)
+        tr = multfix15(wr, or) - multfix15(wi, oi) ;
+        ti = multfix15(wr, oi) + multfix15(wi, or) ;
+        if (features) {
+            // k climbs and j falls through the bands
+            while (k > fft_band_last[bk]) bk++ ;
+            while (bj > 0 && j <= fft_band_last[bj-1]) bj-- ;
+            fr[k] = fft_bin(k, (er + tr) >> 1, (ei + ti) >> 1, bk, features) ;
+            if (j != k) fr[j] = fft_bin(j, (er - tr) >> 1, (ti - ei) >> 1, bj, features) ;
+        }
+        else {
+            fr[k] = (er + tr) >> 1 ;
+            fi[k] = (ei + ti) >> 1 ;
+            if (j != k) {
+                fr[j] = (er - tr) >> 1 ;
+                fi[j] = (ti - ei) >> 1 ;
+            }
+        }
+    }
+}
+
+// Real-input FFT of length 2^log2_len. The real samples come in packed as
+// half as many complex values (fr[n] = x[2n], fi[n] = x[2n+1]). A half
+// size transform plus a split step leaves bins 0..len/2-1 in fr/fi,
+// scaled by 1/len exactly like the complex transform.
+static inline __attribute__((always_inline))
+void FFTfix_real_len(fix15 fr[], fix15 fi[], int log2_len) {
+    FFTfix_len(fr, fi, log2_len - 1) ;
+    FFTfix_real_split(fr, fi, log2_len, 0) ;
+}
+
+// Analysis of one windowed frame already in bit-reversed order (see the
+// front end in protothread_fft). The last stage is the magnitude pass:
+// magnitudes of bins 0..len/2-1 end up in fr, the peak and band sums in
+// the fft_* feature accumulators.
+static inline __attribute__((always_inline))
+void FFTfix_frame_len(fix15 fr[], fix15 fi[], int log2_len) {
+#if REAL_FFT
+    FFTfix_sorted_len(fr, fi, log2_len - 1) ;
+    FFTfix_real_split(fr, fi, log2_len, FEAT_MAG | AUDIO_FEATURES) ;
+#else
+    FFTfix_sorted_len(fr, fi, log2_len) ;
+    FFTfix_magnitudes(fr, fi, log2_len, FEAT_MAG | AUDIO_FEATURES) ;
+#endif
+}
+
+// ---- FFT kernel family ----
+// One complex and one real-input kernel per power of two from
+// 2^FFT_LOG2_MIN up to NUM_SAMPLES, each with its length fixed at compile
+// time. Twiddles and window come from the shared sine table at the
+// length's stride, the bit-reversal list from its slot in the pool. The
+// frame kernels are what protothread_fft runs on each audio frame.
+#define FFT_KERNELS(LOG2) \
+    void FFTfix_##LOG2(fix15 fr[], fix15 fi[]) { FFTfix_len(fr, fi, LOG2) ; } \
+    void FFTfix_real_##LOG2(fix15 fr[], fix15 fi[]) { FFTfix_real_len(fr, fi, LOG2) ; } \
+    void FFTfix_frame_##LOG2(fix15 fr[], fix15 fi[]) { FFTfix_frame_len(fr, fi, LOG2) ; }
+FFT_KERNELS(6)
+FFT_KERNELS(7)
+FFT_KERNELS(8)
+FFT_KERNELS(9)
+FFT_KERNELS(10)
+#if LOG2_NUM_SAMPLES >= 11
+FFT_KERNELS(11)
+#endif
+#if LOG2_NUM_SAMPLES >= 12
+FFT_KERNELS(12)
+#endif
+
+typedef void (*FFTKernel)(fix15 fr[], fix15 fi[]) ;
+// Indexed by log2 length - FFT_LOG2_MIN
+const FFTKernel fft_kernels[] = {
+    FFTfix_6, FFTfix_7, FFTfix_8, FFTfix_9, FFTfix_10,
+#if LOG2_NUM_SAMPLES >= 11
+    FFTfix_11,
+#endif
+#if LOG2_NUM_SAMPLES >= 12
+    FFTfix_12,
+#endif
+} ;
+const FFTKernel fft_real_kernels[] = {
+    FFTfix_real_6, FFTfix_real_7, FFTfix_real_8, FFTfix_real_9, FFTfix_real_10,
+#if LOG2_NUM_SAMPLES >= 11
+    FFTfix_real_11,
+#endif
+#if LOG2_NUM_SAMPLES >= 12
+    FFTfix_real_12,
+#endif
+} ;
+const FFTKernel fft_frame_kernels[] = {
+    FFTfix_frame_6, FFTfix_frame_7, FFTfix_frame_8, FFTfix_frame_9, FFTfix_frame_10,
+#if LOG2_NUM_SAMPLES >= 11
+    FFTfix_frame_11,
+#endif
+#if LOG2_NUM_SAMPLES >= 12
+    FFTfix_frame_12,
+#endif
+} ;
+
+// Full NUM_SAMPLES-point complex FFT
+void FFTfix(fix15 fr[], fix15 fi[]) {
+    FFTfix_len(fr, fi, LOG2_NUM_SAMPLES) ;
+}
+
+// Full NUM_SAMPLES-point real-input FFT (see FFTfix_real_len)
+void FFTfix_real(fix15 fr[], fix15 fi[]) {
+    FFTfix_real_len(fr, fi, LOG2_NUM_SAMPLES) ;
+}
+
+// ---- Audio features ----
+// Turn the accumulators of the 2^log2_len point frame just analyzed into
+// audio_features. sum and sum_sq are the front end's sample sums. The
+// centroid is taken against the band sums, so it needs FEAT_BANDS too.
+void audio_features_publish(int log2_len, uint32_t sum, uint32_t sum_sq,
+                            uint32_t window_us, uint32_t fft_us) {
+    int b ;
+    uint32_t total = 0 ;
+    float mean ;
+    int len = 1 << log2_len ;
+
+    audio_features.frame++ ;
+    audio_features.peak_hz = fft_peak_dex * (Fs / len) ;
+    for (b = 0; b < AUDIO_BANDS; b++) {
+        audio_features.band[b] = fft_band_sum[b] ;
+        total += fft_band_sum[b] ;
+    }
+    audio_features.centroid_hz = total ? (float)fft_centroid_acc * 16.0 / total * (Fs / len) : 0.0 ;
+    // bins of a different length don't line up, so no onset across a resize
+    audio_features.flux = (log2_len == fft_prev_log2) ? fft_flux_acc : 0 ;
+    fft_prev_log2 = log2_len ;
+    mean = (float)sum / len ;
+    audio_features.rms = sqrt(max((float)sum_sq / len - mean * mean, 0.0)) ;
+    audio_features.window_us = window_us ;
+    audio_features.fft_us = fft_us ;
+}
+
+// ---- Boot benchmarks ----
+// Timed in nanoseconds, best of BENCH_TRIALS runs so an interrupted or
+// preempted run doesn't count. The variants under test take turns within
+// each trial, so clock drift hits them alike. The RP2040 reads its
+// microsecond timer and prints cycles. The host reads the wall clock,
+// since its timer may be virtual, does BENCH_REPS times the work to rise
+// above the clock's resolution, and prints nanoseconds.
+#ifdef VGA_HOST
+#define bench_ns() host_wall_ns()
+#define BENCH_REPS 100
+#define BENCH_TRIALS 15
+#else
+#define bench_ns() (time_us_64() * 1000)
+#define BENCH_REPS 1
+#define BENCH_TRIALS 3
+#endif
+
+// Keep the fastest run of a benchmark variant
+#define bench_keep_min(best, t) do { uint64_t t_ = (t) ; if (t_ < (best)) (best) = t_ ; } while (0)
+
+// Time 20 * BENCH_REPS magnitude passes over a full length spectrum with
+// the given features (a constant, so each call compiles its own loop)
+static inline __attribute__((always_inline))
+uint64_t audio_feature_pass_ns(int features) {
+    uint64_t start = bench_ns() ;
+    int n ;
+    for (n = 0; n < 20 * BENCH_REPS; n++) {
+        fft_frame_reset(LOG2_NUM_SAMPLES) ;
+        FFTfix_magnitudes(fr, fi, LOG2_NUM_SAMPLES, features) ;
+    }
+    return bench_ns() - start ;
+}
+
+// Measure what the magnitude pass costs per bin, and what each feature
+// adds on top of it, into audio_feature_ns. Uses fr/fi as scratch, so run
+// it before the FFT thread starts. The scratch spectrum comes from a local
+// generator, so the scenes' rand() sequence is left alone.
+void audio_feature_benchmark(void)
+{
+    uint32_t bins = 20 * BENCH_REPS * (NUM_SAMPLES/2) ;
+    uint64_t ns[5] = {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX} ;
+    uint32_t seed = 1 ;
+    int i ;
+
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u ;
+        fr[i] = (fix15)((seed >> 14) & 0x3FFFF) - 0x20000 ;
+        seed = seed * 1664525u + 1013904223u ;
+        fi[i] = (fix15)((seed >> 14) & 0x3FFFF) - 0x20000 ;
+    }
+    for (i = 0; i < BENCH_TRIALS; i++) {
+        bench_keep_min(ns[0], audio_feature_pass_ns(FEAT_MAG)) ;
+        bench_keep_min(ns[1], audio_feature_pass_ns(FEAT_MAG | FEAT_PEAK)) ;
+        bench_keep_min(ns[2], audio_feature_pass_ns(FEAT_MAG | FEAT_PEAK | FEAT_BANDS)) ;
+        bench_keep_min(ns[3], audio_feature_pass_ns(FEAT_MAG | FEAT_PEAK | FEAT_BANDS | FEAT_CENTROID)) ;
+        bench_keep_min(ns[4], audio_feature_pass_ns(FEAT_MAG | FEAT_PEAK | FEAT_BANDS | FEAT_CENTROID | FEAT_FLUX)) ;
+    }
+    audio_feature_ns[0] = (float)ns[0] / bins ;
+    for (i = 1; i < 5; i++) {
+        audio_feature_ns[i] = (ns[i] > ns[i-1]) ? (float)(ns[i] - ns[i-1]) / bins : 0 ;
+    }
+    // don't let the scratch spectrum show up as the first frame's onset
+    memset(fft_prev_mag, 0, sizeof(fft_prev_mag)) ;
+    fft_prev_log2 = 0 ;
+
+#ifdef VGA_HOST
+    printf("audio features: magnitude %.2f, peak %.2f, bands %.2f, centroid %.2f, flux %.2f ns/bin\n",
+           audio_feature_ns[0], audio_feature_ns[1], audio_feature_ns[2],
+           audio_feature_ns[3], audio_feature_ns[4]) ;
+#else
+    float mhz = clock_get_hz(clk_sys) / 1e6 ;
+    printf("audio features: magnitude %u, peak %u, bands %u, centroid %u, flux %u cycles/bin\n",
+           (unsigned)(audio_feature_ns[0] * mhz / 1000), (unsigned)(audio_feature_ns[1] * mhz / 1000),
+           (unsigned)(audio_feature_ns[2] * mhz / 1000), (unsigned)(audio_feature_ns[3] * mhz / 1000),
+           (unsigned)(audio_feature_ns[4] * mhz / 1000)) ;
+#endif
+}
+
+// ---- Goertzel band bank ----
+// Alternative to the full FFT for when only the bands of the sleeptime
+// ladders matter: a fixed-point Goertzel filter per probe bin, run over
+// small blocks straight out of the capture ring. Probes sit on the bins of
+// a GOERTZEL_N-point DFT, so every ladder band (edges at 100 ... 1500 Hz)
+// gets at least one and a tone never falls between two.
+// 1: Goertzel bank, 0: full FFT peak search
+#define AUDIO_GOERTZEL 0
+// 128-sample blocks (12.8 ms at 10 kHz, 78 Hz bins)
+#define GOERTZEL_LOG2 7
+#define GOERTZEL_N (1 << GOERTZEL_LOG2)
+// Every bin up to the 1500 Hz edge, then a sparse sweep of the top band
+#define GOERTZEL_PROBES 26
+const unsigned char goertzel_bins[GOERTZEL_PROBES] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+                                                      15, 16, 17, 18, 19, 20, 24, 28, 32, 36, 40, 48} ;
+// Weakest tone (ADC counts of amplitude) that counts as a peak
+#define GOERTZEL_MIN_AMP 2
+// 2cos(2 pi k/N) per probe in Q14
+int goertzel_coeff[GOERTZEL_PROBES] ;
+// Band each probe belongs to
+unsigned char goertzel_band[GOERTZEL_PROBES] ;
+// Strongest probe power in each band from the last block
+long long goertzel_power[AUDIO_BANDS] ;
+
+void goertzel_init(void) {
+    int p, b ;
+    for (p = 0; p < GOERTZEL_PROBES; p++) {
+        goertzel_coeff[p] = (int)(2.0 * cos(2.0 * PI * goertzel_bins[p] / GOERTZEL_N) * 16384.0) ;
+        for (b = 0; b < AUDIO_BANDS-1; b++) {
+            if (goertzel_bins[p] * (Fs / GOERTZEL_N) <= audio_band_edges[b]) break ;
+        }
+        goertzel_band[p] = b ;
+    }
+}
+
+// Run every probe over the GOERTZEL_N samples starting at capture index
+// start. Returns the strongest probe, or -1 if none is above the floor.
+int goertzel_block(uint32_t start) {
+
+    int n, p ;
+    int x ;              // DC-free sample
+    int mean = 0 ;
+    int s0, s1[GOERTZEL_PROBES], s2[GOERTZEL_PROBES] ;
+    int best = -1 ;
+    long long power ;
+    long long best_power = (long long)(GOERTZEL_N*GOERTZEL_MIN_AMP/2) * (GOERTZEL_N*GOERTZEL_MIN_AMP/2) ;
+
+    // the microphone sits at mid-scale, take the bias out first so it
+    // can't leak into the low bins
+    for (n = 0; n < GOERTZEL_N; n++) mean += sample_array[(start+n) & CAPTURE_MASK] ;
+    mean >>= GOERTZEL_LOG2 ;
+
+    for (p = 0; p < GOERTZEL_PROBES; p++) {
+        s1[p] = 0 ;
+        s2[p] = 0 ;
+    }
+    for (n = 0; n < GOERTZEL_N; n++) {
+        x = (int)sample_array[(start+n) & CAPTURE_MASK] - mean ;
+        for (p = 0; p < GOERTZEL_PROBES; p++) {
+            s0 = x + (int)(((long long)goertzel_coeff[p] * s1[p]) >> 14) - s2[p] ;
+            s2[p] = s1[p] ;
+            s1[p] = s0 ;
+        }
+    }
+    for (p = 0; p < AUDIO_BANDS; p++) goertzel_power[p] = 0 ;
+    for (p = 0; p < GOERTZEL_PROBES; p++) {
+        power = (long long)s1[p]*s1[p] + (long long)s2[p]*s2[p]
+              - ((((long long)goertzel_coeff[p] * s1[p]) >> 14) * s2[p]) ;
+        if (power > goertzel_power[goertzel_band[p]]) goertzel_power[goertzel_band[p]] = power ;
+        if (power > best_power) {
+            best_power = power ;
+            best = p ;
+        }
+    }
+    return best ;
 }
 
 volatile bool finish_fern = false;
@@ -191,6 +956,11 @@ volatile int sleeptime_ls;
 volatile int sleeptime_fern = 200;
 // Will be used to write dynamic text to screen
 static char freqtext[40];
+// Frequency readout: 14 cells of size 2 text where the black box used to
+// be. Only digits that change are redrawn (core 1 only).
+VgaHudText freq_hud ;
+// Bumped by core 0 after it wipes the screen, so core 1 redraws the HUD
+volatile uint32_t hud_epoch = 0 ;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////// Stuff for Barnsley fern ////////////////////////////////////////////////////////////
@@ -198,6 +968,11 @@ static char freqtext[40];
 // Maximum number of iterations
 #define max_count 1000
 
+// 1: accumulate hit counts per pixel, then map log-density to a color
+// (see fern_accumulate). 0: classic mode, one GREEN pixel per chaos-game
+// point. Only the selected mode's buffers are allocated.
+#define FERN_DENSITY_MODE 0
+
 // State transition equations
 fix15 f1y_coeff_1 = float2fix15(0.16) ; ;
 #define F1x(a,b) 0 ;
@@ -234,6 +1009,458 @@ fix15 f4y_coeff_3 = float2fix15(0.44) ;
 
 fix15 vga_scale = float2fix15(30) ;
 
+// ---- Compile-time specialized kernels ----
+// F1, F3 and F4 never change at runtime, so their coefficients can be
+// folded in as integer constants. mulk15(k,a) is bit-exact with
+// multfix15(k,a) for |k| < 1.0 (a is split at the binary point) but only
+// needs 32-bit multiplies, which gcc turns into shift-adds where cheaper.
+// F2 is randomized per tree and always goes through the generic macros.
+// 1: use the constant kernels, 0: use the generic fix15 globals
+#define FERN_CONST_KERNELS 1
+#define mulk15(k,a) ((fix15)((k)*((a)>>15) + (((k)*((a)&0x7FFF))>>15)))
+#define F1y_k(a,b) (mulk15(float2fix15(0.16),a))
+#define F3x_k(a,b) ((fix15)(mulk15(float2fix15(0.2),a) - mulk15(float2fix15(0.26),b)))
+#define F3y_k(a,b) ((fix15)(mulk15(float2fix15(0.23),a) + mulk15(float2fix15(0.22),b) + float2fix15(1.6)))
+#define F4x_k(a,b) ((fix15)(mulk15(float2fix15(-0.15),a) + mulk15(float2fix15(0.28),b)))
+#define F4y_k(a,b) ((fix15)(mulk15(float2fix15(0.26),a) + mulk15(float2fix15(0.24),b) + float2fix15(0.44)))
+
+// One chaos-game step: pick a map by probability and apply it in place
+static inline void fern_step_generic(fix15 *x, fix15 *y)
+{
+    fix15 x_old = *x ;
+    fix15 y_old = *y ;
+    int test = rand() ;
+    if (test<F1_THRESH) {
+        *x = F1x(x_old, y_old) ;
+        *y = F1y(x_old, y_old) ;
+    }
+    else if (test<F2_THRESH) {
+        *x = F2x(x_old, y_old) ;
+        *y = F2y(x_old, y_old) ;
+    }
+    else if (test<F3_THRESH) {
+        *x = F3x(x_old, y_old) ;
+        *y = F3y(x_old, y_old) ;
+    }
+    else {
+        *x = F4x(x_old, y_old) ;
+        *y = F4y(x_old, y_old) ;
+    }
+}
+
+// Same step with the constant F1/F3/F4 kernels
+static inline void fern_step_const(fix15 *x, fix15 *y)
+{
+    fix15 x_old = *x ;
+    fix15 y_old = *y ;
+    int test = rand() ;
+    if (test<F1_THRESH) {
+        *x = 0 ;
+        *y = F1y_k(x_old, y_old) ;
+    }
+    else if (test<F2_THRESH) {
+        *x = F2x(x_old, y_old) ;
+        *y = F2y(x_old, y_old) ;
+    }
+    else if (test<F3_THRESH) {
+        *x = F3x_k(x_old, y_old) ;
+        *y = F3y_k(x_old, y_old) ;
+    }
+    else {
+        *x = F4x_k(x_old, y_old) ;
+        *y = F4y_k(x_old, y_old) ;
+    }
+}
+
+// Kernels used by the fern thread (left leaf = F3, right leaf = F4)
+#if FERN_CONST_KERNELS
+#define fern_step fern_step_const
+#define leaf3x(a,b) F3x_k(a,b)
+#define leaf3y(a,b) F3y_k(a,b)
+#define leaf4x(a,b) F4x_k(a,b)
+#define leaf4y(a,b) F4y_k(a,b)
+#else
+#define fern_step fern_step_generic
+#define leaf3x(a,b) F3x(a,b)
+#define leaf3y(a,b) F3y(a,b)
+#define leaf4x(a,b) F4x(a,b)
+#define leaf4y(a,b) F4y(a,b)
+#endif
+
+// Time 10 * max_count * BENCH_REPS points of one kernel path: a step
+// plus both leaf maps. The steps draw from rand(), restarted at seed 1 so
+// both paths walk the same sequence.
+#define FERN_BENCH_POINTS (10 * max_count * BENCH_REPS)
+static inline __attribute__((always_inline))
+uint64_t fern_kernel_pass_ns(int use_const) {
+    volatile fix15 sink = 0 ;
+    fix15 x = 0 ;
+    fix15 y = 0 ;
+    uint64_t start ;
+    int n ;
+
+    srand(1) ;
+    start = bench_ns() ;
+    for (n = 0; n < FERN_BENCH_POINTS; n++) {
+        if (use_const) {
+            fern_step_const(&x, &y) ;
+            sink += F3x_k(x, y) + F3y_k(x, y) + F4x_k(x, y) + F4y_k(x, y) ;
+        }
+        else {
+            fern_step_generic(&x, &y) ;
+            sink += F3x(x, y) + F3y(x, y) + F4x(x, y) + F4y(x, y) ;
+        }
+    }
+    return bench_ns() - start ;
+}
+
+// Time both kernel paths and print the cost of one point. rand() is left
+// seeded with 1 plus the benchmark's draws, so call it before main seeds
+// the scenes.
+void fern_kernel_benchmark(void)
+{
+    uint64_t generic_ns = UINT64_MAX, const_ns = UINT64_MAX ;
+    int trial ;
+
+    for (trial = 0; trial < BENCH_TRIALS; trial++) {
+        bench_keep_min(generic_ns, fern_kernel_pass_ns(0)) ;
+        bench_keep_min(const_ns, fern_kernel_pass_ns(1)) ;
+    }
+#ifdef VGA_HOST
+    printf("fern kernels: generic %.2f ns/pt, const %.2f ns/pt\n",
+           (double)generic_ns / FERN_BENCH_POINTS, (double)const_ns / FERN_BENCH_POINTS) ;
+#else
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000 ;
+    printf("fern kernels: generic %u cycles/pt, const %u cycles/pt\n",
+           (unsigned)(generic_ns * mhz / 1000 / FERN_BENCH_POINTS),
+           (unsigned)(const_ns * mhz / 1000 / FERN_BENCH_POINTS)) ;
+#endif
+}
+
+// ---- Burn-in and point-cloud cache ----
+// Points discarded after starting from (0,0), before the orbit is on the attractor
+#define FERN_BURN_IN 20
+
+// Throw away the off-attractor transient
+static inline void fern_burn_in(fix15 *x, fix15 *y)
+{
+    for (int n = 0; n < FERN_BURN_IN; n++) fern_step(x, y) ;
+}
+
+// Classic mode keeps each species' orbit for reuse. Density mode draws
+// fresh points for every leaf, so it has no cache and no stored orbit.
+#if !FERN_DENSITY_MODE
+// Number of cached orbits, 4 kB each
+#define FERN_CACHE_SIZE 4
+// Values each F2 draw is snapped to. With the full rand()%20-style grids
+// there are 294k species and a 4-slot cache never hits; 2 levels give 16
+// species and about a 25% hit rate.
+#define FERN_SPECIES_LEVELS 2
+// Center of the level that draw q (0..n-1) falls in
+#define fern_snap(q,n) ((q) * FERN_SPECIES_LEVELS / (n) * (n) / FERN_SPECIES_LEVELS + (n) / (2 * FERN_SPECIES_LEVELS))
+// Cache key from the quantized F2 draws (bit 31 marks a used slot)
+#define fern_key(a,b,c,d) (0x80000000u | (uint32_t)(a) | ((uint32_t)(b) << 5) | \
+                           ((uint32_t)(c) << 8) | ((uint32_t)(d) << 15))
+// Orbits are stored scale-free in Q4.11 (fern stays within +-16)
+typedef struct {
+    uint32_t key ;
+    uint32_t last_used ;
+    short x[max_count] ;
+    short y[max_count] ;
+} FernCloud ;
+FernCloud fern_cache[FERN_CACHE_SIZE] ;
+uint32_t fern_cache_clock = 0 ;
+uint32_t fern_cache_hits = 0 ;
+uint32_t fern_cache_misses = 0 ;
+
+// Return the cached orbit for key and set *hit, or the least recently
+// used slot (already re-keyed) for the caller to fill
+FernCloud* fern_cache_lookup(uint32_t key, bool *hit)
+{
+    FernCloud *lru = &fern_cache[0] ;
+    for (int n = 0; n < FERN_CACHE_SIZE; n++) {
+        if (fern_cache[n].key == key) {
+            fern_cache[n].last_used = ++fern_cache_clock ;
+            fern_cache_hits++ ;
+            *hit = true ;
+            return &fern_cache[n] ;
+        }
+        if (fern_cache[n].last_used < lru->last_used) lru = &fern_cache[n] ;
+    }
+    lru->key = key ;
+    lru->last_used = ++fern_cache_clock ;
+    fern_cache_misses++ ;
+    *hit = false ;
+    return lru ;
+}
+#endif
+
+// ---- Audio-driven morphing ----
+// While a tree grows, F2 drifts toward a target set by the peak frequency.
+// Each leaf only refreshes the slice of the stored orbit that the change
+// calls for, continuing the chain from the previous point, so the cost per
+// leaf is bounded however fast the audio moves.
+// Most orbit points recomputed per leaf
+#define FERN_MORPH_BUDGET 128
+// Coefficient step (sum over both morphed terms) that refreshes the whole orbit
+#define FERN_MORPH_FULL float2fix15(0.02)
+// This tree's random F2 draws, the morph is applied on top of them
+fix15 f2x_base_1 ;
+fix15 f2y_base_1 ;
+#if !FERN_DENSITY_MODE
+// Working copy of the orbit (Q4.11) and the next index to refresh
+short orbit_x[max_count] ;
+short orbit_y[max_count] ;
+int morph_pos = 0 ;
+#endif
+
+// Ease F2 toward the audio target and return how many orbit points the
+// step invalidates (capped at the per-leaf budget)
+int fern_morph_coeffs(void)
+{
+    // 0..1 across the 0..2 kHz range the scene reacts to
+    fix15 t = float2fix15(min(max_freqency, 2000.0) / 2000.0) ;
+    fix15 dx = (f2x_base_1 + multfix15(t, float2fix15(0.06)) - f2x_coeff_1) >> 2 ;
+    fix15 dy = (f2y_base_1 - multfix15(t, float2fix15(0.06)) - f2y_coeff_1) >> 2 ;
+    f2x_coeff_1 += dx ;
+    f2y_coeff_1 += dy ;
+    return min(FERN_MORPH_BUDGET,
+               (int)(((long long)(abs(dx) + abs(dy)) * max_count) / FERN_MORPH_FULL)) ;
+}
+
+#if !FERN_DENSITY_MODE
+// Re-run the chaos game over n orbit points starting at morph_pos with the
+// current coefficients. Returns the first refreshed index.
+int fern_morph_orbit(int n)
+{
+    int first = morph_pos ;
+    int prev = (morph_pos + max_count - 1) % max_count ;
+    fix15 x = (fix15)orbit_x[prev] << 4 ;
+    fix15 y = (fix15)orbit_y[prev] << 4 ;
+    for (int k = 0; k < n; k++) {
+        fern_step(&x, &y) ;
+        orbit_x[morph_pos] = (short)(x >> 4) ;
+        orbit_y[morph_pos] = (short)(y >> 4) ;
+        if (++morph_pos == max_count) morph_pos = 0 ;
+    }
+    return first ;
+}
+#endif
+
+// ---- Display lists ----
+// 1: record each scene's drawing into display lists (core 0: background,
+// turtle segments and fern pixels; core 1: the HUD) and, when the scene is
+// done, wipe it and replay it from the lists before the next one starts.
+// The replay sets the text cursor, so the live HUD can glitch meanwhile.
+// A list that runs out of room stops recording and is not replayed: the
+// scene stays up as drawn live. display_list_host.c builds with it on.
+#ifndef DISPLAY_LIST
+#define DISPLAY_LIST 0
+#endif
+// Core 0 list, sized from the worst scenes display_list_host has run: 41 kB
+// with classic ferns, 29 kB with density ferns. Fern pixels take 1 to 3
+// bytes and are only kept if they change the screen, turtle segments 8.
+#define DISPLAY_LIST_BYTES 49152
+#define DISPLAY_LIST_HUD_BYTES 2048     // core 1 list
+// Replay speed, 256 = as recorded, 512 = twice as fast, 0 = instantly
+#define DISPLAY_LIST_REPLAY_Q8 0
+#if DISPLAY_LIST
+unsigned char dl_core0_data[DISPLAY_LIST_BYTES] ;
+unsigned char dl_hud_data[DISPLAY_LIST_HUD_BYTES] ;
+VgaDisplayList dl_core0 ;                 // written by core 0 only
+VgaDisplayList dl_hud ;                   // written by core 1 only
+VgaDisplayList dl_hud_end ;               // dl_hud as the scene finished
+char dl_hud_text[VGA_HUD_CELLS + 1] ;     // a HUD field's text as recorded
+const VgaDisplayList *const dl_lists[2] = {&dl_core0, &dl_hud_end} ;
+volatile uint32_t dl_scene = 0 ;          // bumped by core 0 at every scene start
+uint32_t dl_replay_start ;
+
+// Core 1: start a fresh HUD list when core 0 has started a new scene
+void dl_hud_sync(void)
+{
+    static uint32_t scene = 0 ;
+    if (scene != dl_scene) {
+        scene = dl_scene ;
+        vga_dl_init(&dl_hud, dl_hud_data, DISPLAY_LIST_HUD_BYTES, time_us_32()) ;
+    }
+}
+
+// Core 0: record a fern pixel before it is drawn, unless the pixel already
+// has its color. Classic ferns land most of their points on pixels drawn
+// before, and replaying those changes nothing.
+void dl_record_pixel(uint32_t now, uint32_t v)
+{
+    short x = v & 0x3FF ;
+    short y = (v >> 10) & 0x1FF ;
+    char color = (v >> 19) & 0x7 ;
+    if (vga_read_pixel(x, y) != color) vga_dl_pixel(&dl_core0, now, x, y, color) ;
+}
+
+// Replay pacing: wait until us after the replay started
+void dl_pace(uint32_t us)
+{
+    int32_t wait = (int32_t)(dl_replay_start + us - time_us_32()) ;
+    if (wait > 0) sleep_us(wait) ;
+}
+#define dl_record(call) call
+#else
+#define dl_record(call)
+#endif
+
+// ---- Fern point queue between the cores ----
+// Core 1 generates and transforms IFS points and pushes packed pixels,
+// core 0 drains them into the framebuffer at the paced rate while it
+// would otherwise be sleeping between L-system segments.
+// Single producer (core 1), single consumer (core 0), no locks. The
+// indices, and finish_fern, cross cores as acquire loads and release
+// stores: ldr/str plus a dmb on the M0+, and orderings a host race
+// detector can follow.
+#define fern_load(v) __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define fern_store(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#define FERN_RING_SIZE 1024                 // entries, power of two
+#define FERN_RING_MASK (FERN_RING_SIZE-1)
+// Drawing pace: one pixel every 50 us (old loop slept 100 us per leaf pair)
+#define FERN_PIXEL_US 50
+// Packed entry: x in bits 0-9, y in bits 10-18, color in bits 19-21
+#define fern_pack(x,y,c) ((uint32_t)(x) | ((uint32_t)(y) << 10) | ((uint32_t)(c) << 19))
+volatile uint32_t fern_ring[FERN_RING_SIZE] ;
+volatile uint32_t fern_ring_head = 0 ;      // written by core 1 only
+volatile uint32_t fern_ring_tail = 0 ;      // written by core 0 only
+// Producer-side stats (core 1)
+volatile uint32_t fern_ring_peak = 0 ;
+volatile uint32_t fern_ring_stalls = 0 ;
+// Consumer-side stats and pacing (core 0)
+uint32_t fern_drawn = 0 ;
+uint32_t fern_first_draw_time ;
+uint32_t fern_last_draw_time ;
+uint32_t fern_next_draw_time ;
+
+// Free entries as seen by the producer
+static inline uint32_t fern_ring_space(void)
+{
+    return FERN_RING_SIZE - (fern_ring_head - fern_load(fern_ring_tail)) ;
+}
+
+// Queue one on-screen pixel (caller has checked fern_ring_space)
+static inline void fern_push_pixel(int x, int y, char color)
+{
+    uint32_t head = fern_ring_head ;
+    uint32_t used ;
+    if (x < 0 || x > 639 || y < 0 || y > 479) return ;
+    fern_ring[head & FERN_RING_MASK] = fern_pack(x, y, color) ;
+    // publish the entry before the index that makes it visible
+    fern_store(fern_ring_head, head + 1) ;
+    used = head + 1 - fern_load(fern_ring_tail) ;
+    if (used > fern_ring_peak) fern_ring_peak = used ;
+}
+
+// Dequeue one pixel, returns false when the queue is empty
+static inline bool fern_ring_pop(uint32_t *v)
+{
+    uint32_t tail = fern_ring_tail ;
+    if (tail == fern_load(fern_ring_head)) return false ;
+    *v = fern_ring[tail & FERN_RING_MASK] ;
+    // done with the entry before the producer may reuse it
+    fern_store(fern_ring_tail, tail + 1) ;
+    return true ;
+}
+
+// Core 0: spend us microseconds drawing queued fern pixels at the paced rate
+void fern_drain_for_us(uint32_t us)
+{
+    uint32_t now = time_us_32() ;
+    uint32_t end = now + us ;
+    uint32_t v ;
+    while ((int32_t)(end - now) > 0) {
+        if ((int32_t)(now - fern_next_draw_time) >= 0 && fern_ring_pop(&v)) {
+            dl_record(dl_record_pixel(now, v)) ;
+            drawPixel(v & 0x3FF, (v >> 10) & 0x1FF, (v >> 19) & 0x7) ;
+            vga_mark_pixel(v & 0x3FF, (v >> 10) & 0x1FF) ;
+            if (fern_drawn++ == 0) fern_first_draw_time = now ;
+            fern_last_draw_time = now ;
+            // don't bank more than one pixel of credit while idle
+            fern_next_draw_time = max(fern_next_draw_time, now - FERN_PIXEL_US) + FERN_PIXEL_US ;
+        }
+        now = time_us_32() ;
+    }
+}
+
+// ---- Density-histogram rendering ----
+#if FERN_DENSITY_MODE
+// Chaos-game iterations for a full size leaf pair (scaled down with leaf area)
+#define density_count 8000
+#define density_count_min 500
+// Histogram window around the leaf origin, 4-bit counts packed two per byte
+#define HIST_W 224
+#define HIST_H 176
+// Column/row of the leaf origin inside the window (leaves grow up)
+#define HIST_ORIGIN_X 112
+#define HIST_ORIGIN_Y 168
+unsigned char fern_hist[(HIST_W*HIST_H)>>1] ;
+// log2(hit count) -> color, sparse edges dark, dense veins bright
+const char density_palette[5] = {BLACK, BLUE, GREEN, CYAN, YELLOW} ;
+const unsigned char density_level[16] = {0,1,2,2,3,3,3,3,4,4,4,4,4,4,4,4} ;
+
+// Saturating increment of one 4-bit histogram cell
+static inline void hist_hit(int col, int row)
+{
+    if ((unsigned)col >= HIST_W || (unsigned)row >= HIST_H) return ;
+    int cell = row*HIST_W + col ;
+    unsigned char *p = &fern_hist[cell>>1] ;
+    if (cell & 1) {
+        if ((*p & 0xF0) != 0xF0) *p += 0x10 ;
+    }
+    else {
+        if ((*p & 0x0F) != 0x0F) *p += 0x01 ;
+    }
+}
+
+// Run the chaos game from (*x, *y) and bin the left (F3) and right (F4)
+// leaf images of every point. Pure integer work, no framebuffer writes.
+void fern_accumulate(fix15 *x, fix15 *y, fix15 leaf_scale, int count)
+{
+    fix15 x_new = *x ;
+    fix15 y_new = *y ;
+    for (int n = 0; n < count; n++) {
+        fern_step(&x_new, &y_new) ;
+        hist_hit(HIST_ORIGIN_X + (multfix15(leaf_scale, leaf3x(x_new, y_new))>>15),
+                 HIST_ORIGIN_Y - (multfix15(leaf_scale, leaf3y(x_new, y_new))>>15)) ;
+        hist_hit(HIST_ORIGIN_X + (multfix15(leaf_scale, leaf4x(x_new, y_new))>>15),
+                 HIST_ORIGIN_Y - (multfix15(leaf_scale, leaf4y(x_new, y_new))>>15)) ;
+    }
+    *x = x_new ;
+    *y = y_new ;
+}
+
+// Queue every touched cell with its log-density color and clear the
+// histogram on the way. This is the only step that produces pixels.
+// Resumable: returns 0 when the queue fills up, 1 once the window is done.
+int fern_resolve(int origin_x, int origin_y)
+{
+    static int idx = 0 ;    // next histogram byte, kept across calls
+    int row, col ;
+    unsigned char b ;
+    for (; idx < ((HIST_W*HIST_H)>>1); idx++) {
+        b = fern_hist[idx] ;
+        if (b == 0) continue ;
+        if (fern_ring_space() < 2) return 0 ;
+        fern_hist[idx] = 0 ;
+        row = (idx<<1) / HIST_W ;
+        col = (idx<<1) - row*HIST_W ;
+        if (b & 0x0F) {
+            fern_push_pixel(origin_x - HIST_ORIGIN_X + col, origin_y - HIST_ORIGIN_Y + row,
+                            density_palette[density_level[b & 0x0F]]) ;
+        }
+        if (b >> 4) {
+            fern_push_pixel(origin_x - HIST_ORIGIN_X + col + 1, origin_y - HIST_ORIGIN_Y + row,
+                            density_palette[density_level[b >> 4]]) ;
+        }
+    }
+    idx = 0 ;
+    return 1 ;
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////// L-System //////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////
@@ -281,6 +1508,8 @@ int 	x_cur;
 int 	y_cur;
 float 	angle_cur;
 char *curgen;
+// bracket depth of the turtle, 0 on the trunk
+int 	lsys_depth = 0;
 
 void pushstate(void)
 {
@@ -291,6 +1520,7 @@ void pushstate(void)
 	ptr_s->angle = angle_cur;
 	ptr_s->prev = state;
 	state = ptr_s;
+	lsys_depth++;
 }
 
 void popstate(void)
@@ -303,6 +1533,7 @@ void popstate(void)
 	angle_cur = ptr_s->angle;
 	state = state->prev;
 	free(ptr_s);
+	lsys_depth--;
 }
 
 //search in the rule successively for the substitute for char c
@@ -342,12 +1573,110 @@ void nextgen()
 	free(s);
 }
 
+// Turtle segments are queued and drawn LSYS_BATCH at a time, in one color
+// and thickness
+#define LSYS_BATCH 4
+VgaSegment lsys_batch[LSYS_BATCH] ;
+int lsys_batch_count = 0 ;
+char lsys_batch_color ;
+int lsys_batch_radius ;
+
+// 1: branches get thinner with bracket depth, from lsys_depth_radius
+// (drawThickSegments radius, 0 = 1 pixel) down to 1 pixel twigs.
+// raster_replay_host.c builds with it on.
+#ifndef LSYS_THICK
+#define LSYS_THICK 0
+#endif
+const int lsys_depth_radius[] = {2, 1} ;
+#define LSYS_THICK_DEPTHS (int)(sizeof(lsys_depth_radius) / sizeof(lsys_depth_radius[0]))
+
+// Called after each batch of segments is drawn: work out how long to wait
+// from the latest audio features and spend that time drawing fern pixels
+void lsys_pace(void)
+{
+    AudioFeatures audio_ls ;    // consistent copy of the FFT thread's features
+#if GROWTH_ON_BEAT
+    fix15 beat_sub ;            // how far into the current segment slot of the beat
+#endif
+
+    audio_snapshot_read(&audio_ls) ;
+#if GROWTH_ON_BEAT
+    if (audio_ls.beat_period_us) {
+        // wait out the rest of this slot, so batches land on the beat grid
+        beat_sub = (beat_phase_at(&audio_ls, time_us_32()) * LSYS_SLOTS_PER_BEAT) & 0x7FFF ;
+        sleeptime_ls = multfix15(int2fix15(1) - beat_sub, audio_ls.beat_period_us / LSYS_SLOTS_PER_BEAT) ;
+    }
+    else
+#endif
+    if(audio_ls.freq_hz<=100.0){
+        sleeptime_ls = 25000;
+    }
+    else if(audio_ls.freq_hz<=200.0){
+        sleeptime_ls = 8000;
+    }
+    else if(audio_ls.freq_hz<=400.0){
+        sleeptime_ls = 6000;
+    }
+    else if(audio_ls.freq_hz<=800.0){
+        sleeptime_ls = 4000;
+    }
+    else if(audio_ls.freq_hz<=1000.0){
+        sleeptime_ls = 2000;
+    }
+    else if(audio_ls.freq_hz<=1500.0){
+        sleeptime_ls = 1000;
+    }
+    else{
+        sleeptime_ls = 500;
+    }
+    // the ladder is per segment
+    if (!(GROWTH_ON_BEAT && audio_ls.beat_period_us)) sleeptime_ls *= LSYS_BATCH ;
+    setTextColor(WHITE) ;
+    // static char sleeptime_str[40];
+    // sprintf(sleeptime_str, "%d", (int)sleeptime_ls) ;
+    // setCursor(250, 20) ;
+    // setTextSize(2) ;
+    // writeString(sleeptime_str);
+    // setCursor(250,40);
+    // setTextSize(2) ;
+    // writeString(freqtext) ;
+    // draw queued fern pixels instead of idling
+    fern_drain_for_us(sleeptime_ls);
+}
+
+// Draw the queued turtle segments, then pace. Every batch gets its wait,
+// including one cut short by a color or thickness change.
+void lsys_flush(void)
+{
+	if (lsys_batch_count) {
+		drawThickSegments(lsys_batch, lsys_batch_count, lsys_batch_color, lsys_batch_radius) ;
+		dl_record(vga_dl_thick_segments(&dl_core0, time_us_32(), lsys_batch, lsys_batch_count, lsys_batch_color, lsys_batch_radius)) ;
+		lsys_batch_count = 0 ;
+		lsys_pace() ;
+	}
+}
+
+// Queue one segment at the current lsys_depth, drawing the batch when it
+// is full
+void lsys_queue(int x0, int y0, int x1, int y1, char color)
+{
+	int radius = (LSYS_THICK && lsys_depth < LSYS_THICK_DEPTHS) ? lsys_depth_radius[lsys_depth] : 0 ;
+	if (lsys_batch_count && (color != lsys_batch_color || radius != lsys_batch_radius)) lsys_flush() ;
+	lsys_batch[lsys_batch_count].x0 = x0 ;
+	lsys_batch[lsys_batch_count].y0 = y0 ;
+	lsys_batch[lsys_batch_count].x1 = x1 ;
+	lsys_batch[lsys_batch_count].y1 = y1 ;
+	lsys_batch_color = color ;
+	lsys_batch_radius = radius ;
+	if (++lsys_batch_count == LSYS_BATCH) lsys_flush() ;
+}
+
 void forward(char color)
 {
 	int x1, y1;
 	x1 = x_cur + ls->linelen * cos(angle_cur * (PI / 180.0));
 	y1 = y_cur + ls->linelen * sin(angle_cur * (PI / 180.0));
-	drawLine((short)x_cur, (short)y_cur, (short)x1, (short)y1, color);
+	lsys_queue(x_cur, y_cur, x1, y1, color) ;
 	x_cur = x1;
 	y_cur = y1;
 }
@@ -361,6 +1690,112 @@ void rotate(float angle_delta)
 		angle_cur += 360.0;
 }
 
+// ---- Depth-ordered growth ----
+// 1: grow each tree breadth first. Segments are drawn in order of bracket
+// depth (the trunk, then all first-order branches, ...) and in string order
+// within a depth, instead of one deep branch at a time.
+#define LSYS_DEPTH_ORDER 0
+// Most segments in a tree (the current rules make at most 1330). Larger
+// trees are drawn in string order.
+#define LSYS_MAX_SEGMENTS 2048
+// Deeper brackets share the last depth bucket
+#define LSYS_MAX_DEPTH 16
+// Packed segment: x0 + 512 in bits 0-10, y0 + 512 in bits 11-21, signed
+// x1 - x0 in bits 22-26 and y1 - y0 in bits 27-31
+#define lsys_pack(x0,y0,dx,dy) ((uint32_t)((x0) + 512) | ((uint32_t)((y0) + 512) << 11) \
+                                | ((uint32_t)((dx) & 0x1F) << 22) | ((uint32_t)(dy) << 27))
+uint32_t lsys_order[LSYS_MAX_SEGMENTS] ;
+// End of each depth's segments in lsys_order
+int lsys_depth_end[LSYS_MAX_DEPTH] ;
+
+// Turtle pass over s that stores every segment into lsys_order, sorted by
+// depth with a counting sort: one pass counts the segments per depth, the
+// second walks the turtle and drops each segment into the next free slot
+// of its depth, and where each depth ends goes to lsys_depth_end. The
+// turtle state is left as it was. Uses a fixed stack, not pushstate.
+// Returns the number of segments, or -1 if they don't fit.
+int lsys_sort_by_depth(const char *s)
+{
+	int count[LSYS_MAX_DEPTH] ;         // segments per depth, then next free slot
+	int stack_x[LSYS_MAX_DEPTH] ;
+	int stack_y[LSYS_MAX_DEPTH] ;
+	float stack_angle[LSYS_MAX_DEPTH] ;
+	int x0 = x_cur, y0 = y_cur ;
+	float angle0 = angle_cur ;
+	int depth, total, i, x1, y1, n, ok = 1 ;
+	const char *p ;
+
+	memset(count, 0, sizeof(count)) ;
+	for (p = s, depth = 0, total = 0; *p; p++) {
+		if (*p == '[') depth++ ;
+		// an unmatched ']', leave the string to the string-order loop
+		else if (*p == ']' && --depth < 0) return -1 ;
+		else if (*p == 'F') {
+			count[min(depth, LSYS_MAX_DEPTH - 1)]++ ;
+			total++ ;
+		}
+	}
+	if (total > LSYS_MAX_SEGMENTS) return -1 ;
+	// prefix sums: first slot of each depth
+	for (i = 0, n = 0; i < LSYS_MAX_DEPTH; i++) {
+		int c = count[i] ;
+		count[i] = n ;
+		n += c ;
+	}
+
+	for (p = s, depth = 0; *p && ok; p++) {
+		switch (*p) {
+		case 'F':
+			x1 = x_cur + ls->linelen * cos(angle_cur * (PI / 180.0));
+			y1 = y_cur + ls->linelen * sin(angle_cur * (PI / 180.0));
+			if (x_cur < -512 || x_cur > 1535 || y_cur < -512 || y_cur > 1535
+			    || abs(x1 - x_cur) > 15 || abs(y1 - y_cur) > 15) ok = 0 ;
+			lsys_order[count[min(depth, LSYS_MAX_DEPTH - 1)]++] = lsys_pack(x_cur, y_cur, x1 - x_cur, y1 - y_cur) ;
+			x_cur = x1 ;
+			y_cur = y1 ;
+			break ;
+		case '-':
+			rotate(ls->leftangle) ;
+			break ;
+		case '+':
+			rotate(ls->rightangle) ;
+			break ;
+		case '[':
+			if (depth < LSYS_MAX_DEPTH) {
+				stack_x[depth] = x_cur ;
+				stack_y[depth] = y_cur ;
+				stack_angle[depth] = angle_cur ;
+			}
+			else ok = 0 ;
+			depth++ ;
+			break ;
+		case ']':
+			if (--depth < 0) {
+				ok = 0 ;
+				break ;
+			}
+			x_cur = stack_x[depth] ;
+			y_cur = stack_y[depth] ;
+			angle_cur = stack_angle[depth] ;
+			break ;
+		}
+	}
+	x_cur = x0 ;
+	y_cur = y0 ;
+	angle_cur = angle0 ;
+	// every slot pointer now sits at the end of its depth
+	memcpy(lsys_depth_end, count, sizeof(count)) ;
+	return ok ? total : -1 ;
+}
+
+// Queue a packed segment from lsys_order
+void lsys_queue_packed(uint32_t v, char color)
+{
+	int x0 = (int)(v & 0x7FF) - 512 ;
+	int y0 = (int)((v >> 11) & 0x7FF) - 512 ;
+	lsys_queue(x0, y0, x0 + ((int32_t)(v << 5) >> 27), y0 + ((int32_t)v >> 27), color) ;
+}
+
 
 // ==================================================
 // === users audio input thread
@@ -377,72 +1812,165 @@ static PT_THREAD (protothread_fft(struct pt *pt))
     adc_run(true) ;
 
     // Declare some static variables
+    static uint32_t frame_end ;     // capture index one past the frame's last sample
+    static uint32_t analysis_start ; // time_us_32 when this frame's analysis began
+#if AUDIO_GOERTZEL
+    static int probe ;              // strongest Goertzel probe
+#else
     static int i ;                  // incrementing loop variable
 
-    static fix15 max_fr ;           // temporary variable for max freq calculation
-    static int max_fr_dex ;         // index of max frequency
+    static int r ;                  // bit-reversed destination of the next sample
+#if REAL_FFT
+    static int x0, x1 ;             // an even and an odd sample
+#else
+    static int x0 ;                 // the next sample
+#endif
+    static uint32_t sum, sum_sq ;   // sample sums for the RMS
+    static uint32_t window_end ;    // time_us_32 when the front end finished
+    static int fft_len ;            // length of the frame being analyzed
+    static int win_stride ;         // sine table step for its window
+    static int next_log2 ;          // log2 length of the next frame
+    static uint32_t frame_start ;   // capture index of the frame's first sample
+#endif
+    static uint32_t hud_seen ;      // hud_epoch the readout was last drawn in
 
     // Write some text to VGA
     setTextColor(WHITE) ;
     setCursor(65, 0) ;
     setTextSize(1) ;
+    vga_hud_init(&freq_hud, 10, 20, 2, 14, WHITE, BLACK) ;
+    hud_seen = hud_epoch ;
 
 
+#if AUDIO_GOERTZEL
+    goertzel_init() ;
+    frame_end = GOERTZEL_N ;
+#else
+    // first frame ends once a full frame has been captured
+    frame_end = 1u << fft_log2 ;
+#endif
+
     while(1) {
-        // Wait for NUM_SAMPLES samples to be gathered
-        // Measure wait time with timer. THIS IS BLOCKING
-        dma_channel_wait_for_finish_blocking(sample_chan);
-
-        // Copy/window elements into a fixed-point array
-        for (i=0; i<NUM_SAMPLES; i++) {
-            fr[i] = multfix15(int2fix15((int)sample_array[i]), window[i]) ;
-            fi[i] = (fix15) 0 ;
-        }
-
-        // Zero max frequency and max frequency index
-        max_fr = 0 ;
-        max_fr_dex = 0 ;
-
-        // Restart the sample channel, now that we have our copy of the samples
-        dma_channel_start(control_chan) ;
-
-        // Compute the FFT
-        FFTfix(fr, fi) ;
-
-        // Find the magnitudes (alpha max plus beta min)
-        for (int i = 0; i < (NUM_SAMPLES>>1); i++) {  
-            // get the approx magnitude
-            fr[i] = abs(fr[i]); 
-            fi[i] = abs(fi[i]);
-            // reuse fr to hold magnitude
-            fr[i] = max(fr[i], fi[i]) + 
-                    multfix15(min(fr[i], fi[i]), zero_point_4); 
-
-            // Keep track of maximum
-            if (fr[i] > max_fr && i>4 && fr[i]>15000) {
-                max_fr = fr[i] ;
-                max_fr_dex = i ;
-            }
+#if AUDIO_GOERTZEL
+        // One block per pass, no overlap needed at this latency
+        while ((int32_t)(samples_captured() - frame_end) < 0) {
+            PT_YIELD_usec(500) ;
+        }
+        if (samples_captured() - (frame_end - GOERTZEL_N) > CAPTURE_LEN - CAPTURE_MARGIN) {
+            frame_end = samples_captured() ;
+            fft_overruns++ ;
+        }
+        analysis_start = time_us_32() ;
+        probe = goertzel_block(frame_end - GOERTZEL_N) ;
+        frame_end += GOERTZEL_N ;
+        max_freqency = (probe < 0) ? 0.0 : goertzel_bins[probe] * (Fs / GOERTZEL_N) ;
+        audio_frame_us = time_us_32() - analysis_start ;
+        // only the peak of the feature set comes out of the Goertzel bank
+        audio_features.frame++ ;
+        audio_features.peak_hz = max_freqency ;
+        audio_features.fft_us = audio_frame_us ;
+#else
+        // Wait for the capture to pass the end of this frame, letting the
+        // fern thread run meanwhile (the DMA keeps filling the ring)
+        while ((int32_t)(samples_captured() - frame_end) < 0) {
+            PT_YIELD_usec(500) ;
+        }
+        fft_len = 1 << fft_log2 ;
+        win_stride = NUM_SAMPLES >> fft_log2 ;
+        // If analysis fell so far behind that the DMA is about to overwrite
+        // this frame, skip ahead to the newest samples instead
+        if (samples_captured() - (frame_end - fft_len) > CAPTURE_LEN - CAPTURE_MARGIN) {
+            frame_end = samples_captured() ;
+            fft_overruns++ ;
+        }
+        frame_start = frame_end - fft_len ;
+        analysis_start = time_us_32() ;
+
+        // Copy/window elements out of the ring into a fixed-point array,
+        // straight into bit-reversed order so the FFT needs no swap pass.
+        // A sample is an integer, so sample*window is already fix15.
+        // The sums for the RMS come along for free.
+        r = 0 ;
+        sum = 0 ;
+        sum_sq = 0 ;
+#if REAL_FFT
+        // pack even samples into fr and odd samples into fi
+        for (i=0; i<fft_len; i+=2) {
+            x0 = sample_array[(frame_start+i) & CAPTURE_MASK] ;
+            x1 = sample_array[(frame_start+i+1) & CAPTURE_MASK] ;
+            sum += x0 + x1 ;
+            sum_sq += x0*x0 + x1*x1 ;
+            fr[r] = (fix15)x0 * hann(i*win_stride) ;
+            fi[r] = (fix15)x1 * hann((i+1)*win_stride) ;
+            r = bitrev_next(r, fft_len >> 2) ;
+        }
+#else
+        for (i=0; i<fft_len; i++) {
+            x0 = sample_array[(frame_start+i) & CAPTURE_MASK] ;
+            sum += x0 ;
+            sum_sq += x0*x0 ;
+            fr[r] = (fix15)x0 * hann(i*win_stride) ;
+            fi[r] = (fix15) 0 ;
+            r = bitrev_next(r, fft_len >> 1) ;
         }
+#endif
+        window_end = time_us_32() ;
+
+        // Zero the peak and band sums for the magnitude pass
+        fft_frame_reset(fft_log2) ;
+
+        // The next frame ends one hop (of its own length) later
+        next_log2 = min(max(fft_log2_next, FFT_LOG2_MIN), LOG2_NUM_SAMPLES) ;
+        frame_end += (1u << next_log2) >> FFT_HOP_SHIFT ;
+
+        // Compute the FFT, whose last stage finds the magnitudes (alpha
+        // max plus beta min), the peak and the band sums
+        fft_frame_kernels[fft_log2 - FFT_LOG2_MIN](fr, fi) ;
+        audio_features_publish(fft_log2, sum, sum_sq, window_end - analysis_start,
+                               time_us_32() - window_end) ;
+        tempo_update(audio_features.flux, frame_start + fft_len) ;
+
         // fillRect(10, 20, 176, 30, BLACK); // red box
         // setTextColor(WHITE);
         // char max_amp[40];
-        // sprintf(max_amp, "%d", (int)max_fr) ;
+        // sprintf(max_amp, "%d", (int)fft_peak_mag) ;
         // setCursor(10, 20) ;
         // setTextSize(2) ;
         // writeString(max_amp) ;
         // Compute max frequency in Hz
         fft_arr[2] = fft_arr[1];
         fft_arr[1] = fft_arr[0];
-        fft_arr[0] = max_fr_dex * (Fs/NUM_SAMPLES) ;
+        fft_arr[0] = fft_peak_dex * (Fs/fft_len) ;
 
         // average buffer
         max_freqency = round((fft_arr[0] + fft_arr[1] + fft_arr[2]) / 3);
-        fillRect(10, 20, 176, 30, BLACK); // black box
+
+        fft_log2 = next_log2 ;
+#if FFT_AUTO_SIZE
+        // low notes need the resolution of long frames, high notes and
+        // fast passages get the lower latency of short ones
+        if (max_freqency < 300.0) fft_log2_next = LOG2_NUM_SAMPLES ;
+        else if (max_freqency < 1000.0) fft_log2_next = LOG2_NUM_SAMPLES - 1 ;
+        else fft_log2_next = LOG2_NUM_SAMPLES - 2 ;
+#endif
+        audio_frame_us = time_us_32() - analysis_start ;
+#endif
+        // Hand the frame's features to core 0
+        audio_features.freq_hz = max_freqency ;
+        audio_features.time_us = time_us_32() ;
+        audio_snapshot_write(&audio_features) ;
+
         sprintf(freqtext, "%d", (int)max_freqency) ;
-        setCursor(10, 20) ;
-        setTextSize(2) ;
-        writeString(freqtext) ;    
+        if (hud_seen != hud_epoch) {
+            hud_seen = hud_epoch ;
+            vga_hud_invalidate(&freq_hud) ;
+        }
+        dl_record(dl_hud_sync()) ;
+        if (vga_hud_print(&freq_hud, freqtext)) {
+            // the whole field as shown: opaque cells, padded with spaces
+            dl_record(sprintf(dl_hud_text, "%-*.*s", freq_hud.cells, freq_hud.cells, freqtext)) ;
+            dl_record(vga_dl_text(&dl_hud, audio_features.time_us, 10, 20, 2, WHITE, BLACK, dl_hud_text)) ;
+        }
 
         // // Update the FFT display
         // for (int i=5; i<(NUM_SAMPLES>>1); i++) {
@@ -455,6 +1983,48 @@ static PT_THREAD (protothread_fft(struct pt *pt))
     PT_END(pt) ;
 }
 
+// Mountain and cabin outline behind every tree
+const VgaSegment background_segments[] = {
+    {0, 480, 540, 360},
+    {540, 180, 580, 30},
+    {580, 30, 620, 180},
+    {580, 30, 567, 180},
+    {580, 30, 594, 180},
+} ;
+
+// The background is drawn once at boot and captured into a run-length
+// layer. Every scene then puts it back with a few hundred small memcpys
+// instead of redrawing the outline, circle and rectangle pixel by pixel.
+#define BACKGROUND_LAYER_BYTES 6144
+unsigned char background_data[BACKGROUND_LAYER_BYTES] ;
+VgaLayer background_layer = {.data = background_data, .capacity = BACKGROUND_LAYER_BYTES} ;
+bool background_captured = false ;
+
+void draw_background(void) {
+    drawSegments(background_segments, sizeof(background_segments)/sizeof(background_segments[0]), WHITE) ;
+    drawCircle((short)580, (short)250, (short)20, WHITE) ;
+    drawRectFast((short) 540, (short) 180, (short) 80, (short)300, WHITE);
+    vga_mark_rect(560, 230, 41, 41) ;
+}
+
+#if DISPLAY_LIST
+// The background as display list records, however it was put on screen
+void dl_record_background(uint32_t now) {
+    vga_dl_segments(&dl_core0, now, background_segments, sizeof(background_segments)/sizeof(background_segments[0]), WHITE) ;
+    vga_dl_circle(&dl_core0, now, 580, 250, 20, WHITE) ;
+    vga_dl_rect(&dl_core0, now, 540, 180, 80, 300, WHITE) ;
+}
+#endif
+
+// Call before core 1 starts, while nothing else is on the screen
+void background_init(void) {
+    draw_background() ;
+    background_captured = (vga_layer_capture(&background_layer) == 0) ;
+    printf("background layer: %u of %d bytes%s\n", background_layer.size,
+           BACKGROUND_LAYER_BYTES, background_captured ? "" : " (overflow, redrawing instead)") ;
+    vga_clear_dirty(BLACK) ;
+}
+
 // thread for L-System trees
 static PT_THREAD (protothread_lsys(struct pt *pt))
 {
@@ -498,15 +2068,22 @@ static PT_THREAD (protothread_lsys(struct pt *pt))
 	ls->rules = ptr_r1;
     char color_ls = 2;
     int iteration = 4;
+#if LSYS_DEPTH_ORDER
+    int lsys_count ;            // segments in depth order, -1 to use string order
+#endif
+    unsigned int cleared ;      // framebuffer bytes wiped at the end of a scene
+#if DISPLAY_LIST
+    unsigned int replayed ;     // display list records drawn by the replay
+#endif
     while(1) {
+#if DISPLAY_LIST
+        dl_scene++ ;
+        vga_dl_init(&dl_core0, dl_core0_data, DISPLAY_LIST_BYTES, time_us_32()) ;
+        dl_record_background(time_us_32()) ;
+#endif
         //draw background picture
-        drawLine((short)0, (short)480, (short)540, (short)360, WHITE);
-        drawLine((short)540, (short)180, (short)580, (short)30, WHITE);
-        drawLine((short)580, (short)30, (short)620, (short)180, WHITE);
-        drawLine((short)580, (short)30, (short)567, (short)180, WHITE);
-        drawLine((short)580, (short)30, (short)594, (short)180, WHITE);
-        drawCircle((short)580, (short)250, (short)20, WHITE) ;
-        drawRect((short) 540, (short) 180, (short) 80, (short)300, WHITE);
+        if (background_captured) vga_layer_restore(&background_layer) ;
+        else draw_background() ;
         finish_ls = false;
         //initialize position
 	    x_cur = 270;
@@ -525,43 +2102,21 @@ static PT_THREAD (protothread_lsys(struct pt *pt))
             printf("iteration%d,curgen=%s\n", i, curgen);
             nextgen();
         }
+#if LSYS_DEPTH_ORDER
+        lsys_count = lsys_sort_by_depth(curgen) ;
+        for (int i = 0; i < lsys_count; i++) {
+            while (i >= lsys_depth_end[lsys_depth]) lsys_depth++ ;
+            lsys_queue_packed(lsys_order[i], color_ls) ;
+        }
+        lsys_depth = 0 ;
+        if (lsys_count < 0)
+#endif
         for (char* s = curgen; *s!='\0'; s++) {
             switch (*s) {
             case 'X':
                 break;
             case 'F':
-                 if(max_freqency<=100.0){
-            sleeptime_ls = 25000;
-            }
-            else if(max_freqency<=200.0){
-            sleeptime_ls = 8000;
-            }
-            else if(max_freqency<=400.0){
-            sleeptime_ls = 6000;
-            }
-            else if(max_freqency<=800.0){
-            sleeptime_ls = 4000;
-            }
-            else if(max_freqency<=1000.0){
-            sleeptime_ls = 2000;
-            }
-            else if(max_freqency<=1500.0){
-            sleeptime_ls = 1000;
-            }
-            else{
-            sleeptime_ls = 500;
-            }
                 forward(color_ls);
-                setTextColor(WHITE) ;
-                // static char sleeptime_str[40];
-                // sprintf(sleeptime_str, "%d", (int)sleeptime_ls) ;
-                // setCursor(250, 20) ;
-                // setTextSize(2) ;
-                // writeString(sleeptime_str);
-                // setCursor(250,40);
-                // setTextSize(2) ;
-                // writeString(freqtext) ;
-                sleep_us(sleeptime_ls);
                 break;
             case '-':
                 rotate(ls->leftangle);
@@ -577,6 +2132,7 @@ static PT_THREAD (protothread_lsys(struct pt *pt))
                 break;
             }
         }
+        lsys_flush() ;
         free(curgen);
         //update parameters: color length rules angle 
         //rules:
@@ -625,9 +2181,48 @@ static PT_THREAD (protothread_lsys(struct pt *pt))
             color_ls = 3;
         }
         finish_ls = true;
-        while(!finish_fern);
+        // finish drawing whatever the fern thread still has queued
+        while(!fern_load(finish_fern) || fern_ring_tail != fern_load(fern_ring_head)) {
+            fern_drain_for_us(1000);
+        }
+        printf("fern: %u px in %u us (%u px/s), queue peak %u/%d, %u producer stalls\n",
+               fern_drawn, fern_last_draw_time - fern_first_draw_time,
+               (unsigned)(fern_drawn * 1000000ull / max(1u, fern_last_draw_time - fern_first_draw_time)),
+               fern_ring_peak, FERN_RING_SIZE, fern_ring_stalls);
+        fern_drawn = 0;
         sleep_ms(1000);
-        fillRect(0,0,640,480,BLACK);
+#if DISPLAY_LIST
+        // core 1 goes on printing the HUD, and recording it, meanwhile
+        dl_hud_end = dl_hud ;
+        if (dl_core0.overflowed || dl_hud_end.overflowed) {
+            // the lists miss part of the scene, leave the live one up
+            printf("display list: overflowed, %u + %u records dropped, not replayed\n",
+                   dl_core0.dropped, dl_hud_end.dropped) ;
+        }
+        else {
+#ifdef VGA_HOST
+            if (host_scene_drawn) host_scene_drawn() ;
+#endif
+            // show the scene again from its display lists
+            vga_clear_dirty(BLACK) ;
+            hud_epoch++ ;
+            dl_replay_start = time_us_32() ;
+            replayed = vga_dl_replay(dl_lists, 2, DISPLAY_LIST_REPLAY_Q8, dl_pace) ;
+#ifdef VGA_HOST
+            if (host_scene_replayed) host_scene_replayed() ;
+#endif
+            printf("display list: %u records in %u + %u bytes, replayed in %u us\n",
+                   replayed, dl_core0.size, dl_hud_end.size, time_us_32() - dl_replay_start) ;
+            sleep_ms(1000) ;
+        }
+#endif
+#ifdef VGA_HOST
+        host_scene_done() ;
+#endif
+        // wipe only the tiles this scene drew on
+        cleared = vga_clear_dirty(BLACK) ;
+        hud_epoch++ ;
+        printf("clear: %u of 153600 bytes (%u%%)\n", cleared, cleared * 100 / 153600) ;
      // NEVER exit while
     } // END WHILE(1)
   PT_END(pt);
@@ -641,12 +2236,6 @@ static PT_THREAD (protothread_fern(struct pt *pt))
     PT_BEGIN(pt);
     static fix15 x_old ;
     static fix15 y_old ;
-    static fix15 x_new ;
-    static fix15 y_new ;
-
-    static fix15 scaled_x ;
-    static fix15 scaled_y ;
-    
 
     // uint32_t start_time ;
     // uint32_t end_time ;
@@ -663,18 +2252,11 @@ static PT_THREAD (protothread_fern(struct pt *pt))
     static int tree_y = 0;
 
     //loop variables 
-    //pixel points
-    static int i;
-    static int j;
     //tree number 
     static int tree;
     static int leaf;
     static int vga_scale_int;
-    static int test;
-    static fix15 scaled_x_left[max_count];
-    static fix15 scaled_y_left[max_count];
-    static fix15 scaled_x_right[max_count];
-    static fix15 scaled_y_right[max_count];
+    static int q_f2x_1, q_f2x_2, q_f2y_1, q_f2y_3;
 
     static int max_l;
     static float scale_current;
@@ -683,12 +2265,30 @@ static PT_THREAD (protothread_fern(struct pt *pt))
     static int x_offset_increment;
     static int y_offset;
     static int y_offset_increment;
+#if FERN_DENSITY_MODE
+    static fix15 leaf_scale;
+#else
+    //pixel points
+    static int i;
+    static int j;
+    static fix15 x_new ;
+    static fix15 y_new ;
+    static FernCloud *cloud;
+    static bool cloud_hit;
+    static int morph_count;
+    static fix15 scaled_x_left[max_count];
+    static fix15 scaled_y_left[max_count];
+    static fix15 scaled_x_right[max_count];
+    static fix15 scaled_y_right[max_count];
     static fix15 x_shrinked_left;
     static fix15 x_shrinked_right;
     static fix15 y_shrinked_left;
     static fix15 y_shrinked_right;
+#endif
     while(1) {
-        finish_fern = false;
+        fern_store(finish_fern, false);
+        fern_ring_peak = 0;
+        fern_ring_stalls = 0;
         for( tree = 0; tree < num_trees; tree++){
             x_old = 0 ;
             y_old = 0 ;
@@ -700,50 +2300,84 @@ static PT_THREAD (protothread_fern(struct pt *pt))
             y_offset = 460;
             y_offset_increment = 80;
         // randomize F2 function to generate different leaves
-        f2x_coeff_1 = float2fix15((float)(rand() % 20 + 70) / 100.0);   //  0.70 - 0.90
-        f2x_coeff_2 = float2fix15((float)(rand() % 7 ) / 100.0);   // 0 - 0.06
-        f2y_coeff_1 = float2fix15((float)(rand() % 21 - 20) / 100.0);   // -0.2 - 0
-        f2y_coeff_3 = float2fix15((float)(rand() % 100 + 100) / 100.0); //  1.00 - 2.00
+        q_f2x_1 = rand() % 20;
+        q_f2x_2 = rand() % 7;
+        q_f2y_1 = rand() % 21;
+        q_f2y_3 = rand() % 100;
+#if !FERN_DENSITY_MODE
+        // a coarse grid of species, so the orbit cache gets hits
+        q_f2x_1 = fern_snap(q_f2x_1, 20);
+        q_f2x_2 = fern_snap(q_f2x_2, 7);
+        q_f2y_1 = fern_snap(q_f2y_1, 21);
+        q_f2y_3 = fern_snap(q_f2y_3, 100);
+#endif
+        f2x_coeff_1 = float2fix15((float)(q_f2x_1 + 70) / 100.0);   //  0.70 - 0.90
+        f2x_coeff_2 = float2fix15((float)(q_f2x_2 ) / 100.0);   // 0 - 0.06
+        f2y_coeff_1 = float2fix15((float)(q_f2y_1 - 20) / 100.0);   // -0.2 - 0
+        f2y_coeff_3 = float2fix15((float)(q_f2y_3 + 100) / 100.0); //  1.00 - 2.00
         vga_scale_int = rand() % 20 + 15;
         vga_scale = int2fix15(vga_scale_int);  
+        f2x_base_1 = f2x_coeff_1;
+        f2y_base_1 = f2y_coeff_1;
+#if FERN_DENSITY_MODE
+        // start the orbit on the attractor
+        fern_burn_in(&x_old, &y_old);
+#else
+        // the orbit only depends on the F2 draws, vga_scale is applied below
+        cloud = fern_cache_lookup(fern_key(q_f2x_1, q_f2x_2, q_f2y_1, q_f2y_3), &cloud_hit);
+        if (!cloud_hit) {
+            // start the orbit on the attractor
+            fern_burn_in(&x_old, &y_old);
+            for (i=0; i<max_count; i++) {
+                fern_step(&x_old, &y_old);
+                cloud->x[i] = (short)(x_old >> 4);
+                cloud->y[i] = (short)(y_old >> 4);
+            }
+        }
+        // morphing works on a copy so the cached species stays intact
+        memcpy(orbit_x, cloud->x, sizeof(orbit_x));
+        memcpy(orbit_y, cloud->y, sizeof(orbit_y));
+        morph_pos = 0;
         //generate left leaves and right leaves model
         for (i=0; i<max_count; i++) {
-
-            test = rand() ;
-
-            if (test<F1_THRESH) {
-                x_new = F1x(x_old, y_old) ;
-                y_new = F1y(x_old, y_old) ;
-            }
-            else if (test<F2_THRESH) {
-                x_new = F2x(x_old, y_old) ;
-                y_new = F2y(x_old, y_old) ;
-            }
-            else if (test<F3_THRESH) {
-                x_new = F3x(x_old, y_old) ;
-                y_new = F3y(x_old, y_old) ;
-            }
-            else {
-                x_new = F4x(x_old, y_old) ;
-                y_new = F4y(x_old, y_old) ;
-            }
-
-            // scaled_x = multfix15(vga_scale, x_new) ;
-            // scaled_y = multfix15(vga_scale, y_new) ;
-            
+            x_new = (fix15)orbit_x[i] << 4 ;
+            y_new = (fix15)orbit_y[i] << 4 ;
             //left leaves scaled points
-            scaled_x_left[i] = multfix15(vga_scale, F3x(x_new, y_new)) ;
-            scaled_y_left[i] = multfix15(vga_scale, F3y(x_new,y_new)) ;
-            scaled_x_right[i] = multfix15(vga_scale, F4x(x_new, y_new)) ;
-            scaled_y_right[i] = multfix15(vga_scale, F4y(x_new,y_new)) ;
-            
-            x_old = x_new ;
-            y_old = y_new ;
+            scaled_x_left[i] = multfix15(vga_scale, leaf3x(x_new, y_new)) ;
+            scaled_y_left[i] = multfix15(vga_scale, leaf3y(x_new,y_new)) ;
+            scaled_x_right[i] = multfix15(vga_scale, leaf4x(x_new, y_new)) ;
+            scaled_y_right[i] = multfix15(vga_scale, leaf4y(x_new,y_new)) ;
         }
+#endif
         x_offset_increment = rand() % 20 - 10;
         y_offset_increment = vga_scale_int * 2;
         //draw leaves on the tree
         for (leaf = 0; leaf<max_l; leaf++) {
+#if FERN_DENSITY_MODE
+            // follow the audio, every leaf is regenerated with the new F2 anyway
+            fern_morph_coeffs();
+            // bin many more points than classic mode, then plot once
+            leaf_scale = multfix15(vga_scale, float2fix15(scale_current)) ;
+            fern_accumulate(&x_old, &y_old, leaf_scale,
+                            max(density_count_min, (int)(density_count*scale_current*scale_current))) ;
+            while (!fern_resolve(x_offset + tree_x, y_offset - tree_y)) {
+                fern_ring_stalls++ ;
+                PT_YIELD_usec(1000) ;
+            }
+#else
+            // follow the audio, refreshing only the invalidated slice of the
+            // orbit and its leaf images
+            morph_count = fern_morph_coeffs();
+            i = fern_morph_orbit(morph_count);
+            for (j=0; j<morph_count; j++) {
+                x_new = (fix15)orbit_x[i] << 4 ;
+                y_new = (fix15)orbit_y[i] << 4 ;
+                scaled_x_left[i] = multfix15(vga_scale, leaf3x(x_new, y_new)) ;
+                scaled_y_left[i] = multfix15(vga_scale, leaf3y(x_new,y_new)) ;
+                scaled_x_right[i] = multfix15(vga_scale, leaf4x(x_new, y_new)) ;
+                scaled_y_right[i] = multfix15(vga_scale, leaf4y(x_new,y_new)) ;
+                if (++i == max_count) i = 0;
+            }
             //draw each pixel on two leaves
             for (j=0; j<max_count; j++) {
                 // left leaf
@@ -752,11 +2386,15 @@ static PT_THREAD (protothread_fern(struct pt *pt))
                 // right leaf
                 x_shrinked_right = multfix15(scaled_x_right[j], float2fix15(scale_current));
                 y_shrinked_right = multfix15(scaled_y_right[j], float2fix15(scale_current));
-                // draw both leaves
-                drawPixel((x_shrinked_left >>15) + x_offset + tree_x, y_offset-(y_shrinked_left >>15)-tree_y, GREEN) ;
-                drawPixel((x_shrinked_right>>15) + x_offset + tree_x, y_offset-(y_shrinked_right>>15)-tree_y, GREEN) ;
-                sleep_us(100);
+                // queue both leaves, core 0 draws them at the paced rate
+                while (fern_ring_space() < 2) {
+                    fern_ring_stalls++ ;
+                    PT_YIELD_usec(1000) ;
+                }
+                fern_push_pixel((x_shrinked_left >>15) + x_offset + tree_x, y_offset-(y_shrinked_left >>15)-tree_y, GREEN) ;
+                fern_push_pixel((x_shrinked_right>>15) + x_offset + tree_x, y_offset-(y_shrinked_right>>15)-tree_y, GREEN) ;
             }
+#endif
 
             // growth speed control
             if(max_freqency<=10.0){
@@ -791,12 +2429,17 @@ static PT_THREAD (protothread_fern(struct pt *pt))
         tree_x += 260;
         tree_y += 70;
     }
-    finish_fern = true;
+#if !FERN_DENSITY_MODE
+    printf("fern cache: %u hits, %u misses\n", fern_cache_hits, fern_cache_misses);
+#endif
+    fern_store(finish_fern, true);
     while(finish_ls==false){
         PT_YIELD_usec(2000);
     }
     //PT_YIELD_usec(2000000);
-    sleep_ms(1000);
+    // yield rather than sleep, so finish_fern stays visible to core 0 (the
+    // host shim runs a core 1 sleep_ms at once) and the FFT thread runs on
+    PT_YIELD_usec(1000000);
     tree_x = 160;
     tree_y = 0;
     // NEVER exit while
@@ -825,6 +2468,10 @@ int main(){
   stdio_init_all() ;
   // initialize VGA
   initVGA() ;
+  // capture the static background while the screen is still empty
+  background_init() ;
+  // cost of the constant vs generic fern kernels
+  fern_kernel_benchmark() ;
   srand(12345);
 
     ///////////////////////////////////////////////////////////////////////////////
@@ -859,12 +2506,10 @@ int main(){
     adc_set_clkdiv(ADCCLK/Fs);
 
 
-    // Populate the sine table and Hann window table
-    int ii;
-    for (ii = 0; ii < NUM_SAMPLES; ii++) {
-        Sinewave[ii] = float2fix15(sin(6.283 * ((float) ii) / (float)NUM_SAMPLES));
-        window[ii] = float2fix15(0.5 * (1.0 - cos(6.283 * ((float) ii) / ((float)NUM_SAMPLES))));
-    }
+    // Populate the sine table and the bit-reversal lists of every FFT size
+    FFTfix_init_tables() ;
+    // Cost of the magnitude pass and of each audio feature
+    audio_feature_benchmark() ;
 
     /////////////////////////////////////////////////////////////////////////////////
     // ============================== ADC DMA CONFIGURATION =========================
@@ -880,14 +2525,18 @@ int main(){
     channel_config_set_transfer_data_size(&c2, DMA_SIZE_8);
     channel_config_set_read_increment(&c2, false);
     channel_config_set_write_increment(&c2, true);
+    // Wrap the write address around the capture ring
+    channel_config_set_ring(&c2, true, CAPTURE_LOG2);
     // Pace transfers based on availability of ADC samples
     channel_config_set_dreq(&c2, DREQ_ADC);
+    // Hand back to the control channel if the count ever runs out
+    channel_config_set_chain_to(&c2, control_chan);
     // Configure the channel
     dma_channel_configure(sample_chan,
         &c2,            // channel config
         sample_array,   // dst
         &adc_hw->fifo,  // src
-        NUM_SAMPLES,    // transfer count
+        CAPTURE_COUNT,  // transfer count
         false            // don't start immediately
     );
 
@@ -915,4 +2564,5 @@ int main(){
 
   // start scheduler
   pt_schedule_start ;
+  return 0 ;
 } 
@@ -0,0 +1,54 @@
+/**
+ * Host driver for trees_demo.c
+ *
+ * Runs the demo unchanged on pico_host.c and vga_graphics_host.c, and
+ * reports each finished scene:
+ *     make VGA_DIR=<VGA library dir> trees_host
+ *     ./trees_host [scenes [ppm]]
+ * Every scene prints "scene N: checksum XXXXXXXX" (vga_host_checksum of
+ * the finished framebuffer) and, if ppm is given, is written there as a
+ * PPM. A %d in ppm is replaced by the scene number. The program exits after
+ * the last scene (default 1). The clock is virtual unless TREES_CLOCK=real,
+ * so a build prints the same checksums on every run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define main trees_demo_main
+#include "trees_demo.c"
+#undef main
+#include "vga_graphics_host.h"
+
+static int host_scenes = 1 ;            // scenes to draw before exiting
+static const char *host_ppm = NULL ;    // PPM path, NULL for none
+static int host_scene = 0 ;             // scenes finished so far
+
+void host_scene_done(void) {
+    char path[256] ;
+    host_scene++ ;
+    printf("scene %d: checksum %08lx\n", host_scene, vga_host_checksum()) ;
+    if (host_ppm != NULL) {
+        if (strstr(host_ppm, "%d") != NULL) snprintf(path, sizeof(path), host_ppm, host_scene) ;
+        else snprintf(path, sizeof(path), "%s", host_ppm) ;
+        if (vga_host_dump_ppm(path) != 0) {
+            fprintf(stderr, "trees_host: cannot write %s\n", path) ;
+            exit(1) ;
+        }
+    }
+    if (host_scene >= host_scenes) {
+        fflush(stdout) ;
+        exit(0) ;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 3 || (argc > 1 && atoi(argv[1]) <= 0)) {
+        fprintf(stderr, "usage: %s [scenes [ppm]]\n", argv[0]) ;
+        return 2 ;
+    }
+    if (argc > 1) host_scenes = atoi(argv[1]) ;
+    if (argc > 2) host_ppm = argv[2] ;
+    return trees_demo_main() ;
+}
@@ -0,0 +1,16 @@
+/**
+ * The RP2040 VGA driver, built through this file
+ *
+ * vga_graphics.c includes glcdfont.c, whose font array is static.
+ * Compiling the driver from here adds one exported pointer to that array,
+ * vga_font. vga_hud.c rasterizes its glyphs through it, so the image
+ * carries the 1280 byte font once instead of a second copy for the HUD.
+ * List this file in the firmware's sources in place of vga_graphics.c.
+ * Host builds link vga_graphics_host.c instead, which exports vga_font
+ * the same way.
+ */
+
+#include "vga_graphics.c"
+#include "vga_hud.h"
+
+const unsigned char *const vga_font = font ;
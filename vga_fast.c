@@ -0,0 +1,543 @@
+/**
+ * Batched drawing primitives for the VGA framebuffer (see vga_fast.h)
+ *
+ * drawLine pays a call, a full Bresenham setup and a clamp per pixel
+ * (through drawPixel) for every segment, which dominates for the 2-5 pixel
+ * segments the turtle draws. drawSegments takes a whole array in one color.
+ * It clips each segment once with Cohen-Sutherland outcodes (almost always
+ * a trivial accept), then steps a packed pixel index directly through
+ * vga_data_array.
+ *
+ * Every segment also marks the tiles it covers in the dirty map, so a
+ * scene can be cleared with vga_clear_dirty instead of a full-screen fill.
+ * Static scenery can be captured once into a run-length layer and put
+ * back after each clear with a handful of memcpys.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vga_graphics.h"
+#include "vga_fast.h"
+
+// Screen size
+#define _width 640
+#define _height 480
+
+// Pixel color array, owned by the VGA driver (or the host backend)
+extern unsigned char vga_data_array[] ;
+
+// Size of the framebuffer in bytes
+#define TXCOUNT 153600
+
+// Bit masks for the two pixels of a byte
+#define TOPMASK 0b11000111
+#define BOTTOMMASK 0b11111000
+
+// Bytes per scanline, and per scanline of one tile
+#define ROW_BYTES (_width / 2)
+#define TILE_BYTES ((1 << VGA_TILE_LOG2) / 2)
+
+unsigned char vga_dirty[VGA_TILES_Y][VGA_TILES_X] ;
+
+// Longest black gap that capture copies instead of starting a new run
+#define LAYER_GAP 3
+
+#ifndef min
+#define min(a,b) ((a<b) ? a:b)
+#endif
+#ifndef max
+#define max(a,b) ((a<b) ? b:a)
+#endif
+
+// Cohen-Sutherland outcodes
+#define OUT_LEFT   1
+#define OUT_RIGHT  2
+#define OUT_TOP    4
+#define OUT_BOTTOM 8
+
+static inline int outcode(int x, int y, int width, int height) {
+    int code = 0 ;
+    if (x < 0) code |= OUT_LEFT ;
+    else if (x >= width) code |= OUT_RIGHT ;
+    if (y < 0) code |= OUT_TOP ;
+    else if (y >= height) code |= OUT_BOTTOM ;
+    return code ;
+}
+
+int vga_clip_segment(int *x0, int *y0, int *x1, int *y1, int width, int height) {
+    int code0 = outcode(*x0, *y0, width, height) ;
+    int code1 = outcode(*x1, *y1, width, height) ;
+    int code, x, y ;
+
+    while (code0 | code1) {
+        // both ends off the same side
+        if (code0 & code1) return 0 ;
+        code = code0 ? code0 : code1 ;
+        if (code & OUT_TOP) {
+            x = *x0 + (*x1 - *x0) * (0 - *y0) / (*y1 - *y0) ;
+            y = 0 ;
+        }
+        else if (code & OUT_BOTTOM) {
+            x = *x0 + (*x1 - *x0) * (height - 1 - *y0) / (*y1 - *y0) ;
+            y = height - 1 ;
+        }
+        else if (code & OUT_LEFT) {
+            y = *y0 + (*y1 - *y0) * (0 - *x0) / (*x1 - *x0) ;
+            x = 0 ;
+        }
+        else {
+            y = *y0 + (*y1 - *y0) * (width - 1 - *x0) / (*x1 - *x0) ;
+            x = width - 1 ;
+        }
+        if (code == code0) {
+            *x0 = x ;
+            *y0 = y ;
+            code0 = outcode(x, y, width, height) ;
+        }
+        else {
+            *x1 = x ;
+            *y1 = y ;
+            code1 = outcode(x, y, width, height) ;
+        }
+    }
+    return 1 ;
+}
+
+void drawSegments(const VgaSegment *seg, int count, char color) {
+    int x0, y0, x1, y1, t ;
+    int dx, dy, err, n ;
+    int pixel ;     // index of the current pixel on the screen
+    int major ;     // pixel index step along the long axis
+    int minor ;     // pixel index step along the short axis
+    int steep ;
+    unsigned char lo = color ;          // color in the even pixel's bits
+    unsigned char hi = color << 3 ;     // color in the odd pixel's bits
+    unsigned char *b ;
+    int tx, ty, tx1, ty1 ;
+
+    for (; count > 0; count--, seg++) {
+        x0 = seg->x0 ;
+        y0 = seg->y0 ;
+        x1 = seg->x1 ;
+        y1 = seg->y1 ;
+        // Turtle segments are a few pixels long and nearly all on screen,
+        // so the clipping and the tile marking are most of their cost
+        if (((unsigned)x0 >= _width || (unsigned)x1 >= _width ||
+             (unsigned)y0 >= _height || (unsigned)y1 >= _height) &&
+            !vga_clip_segment(&x0, &y0, &x1, &y1, _width, _height)) continue ;
+        tx1 = max(x0, x1) >> VGA_TILE_LOG2 ;
+        ty1 = max(y0, y1) >> VGA_TILE_LOG2 ;
+        for (ty = min(y0, y1) >> VGA_TILE_LOG2; ty <= ty1; ty++) {
+            for (tx = min(x0, x1) >> VGA_TILE_LOG2; tx <= tx1; tx++) vga_dirty[ty][tx] = 1 ;
+        }
+
+        // Same stepping as drawLine, so the pixels match it
+        steep = abs(y1 - y0) > abs(x1 - x0) ;
+        if (steep) {
+            t = x0 ; x0 = y0 ; y0 = t ;
+            t = x1 ; x1 = y1 ; y1 = t ;
+        }
+        if (x0 > x1) {
+            t = x0 ; x0 = x1 ; x1 = t ;
+            t = y0 ; y0 = y1 ; y1 = t ;
+        }
+        dx = x1 - x0 ;
+        dy = abs(y1 - y0) ;
+        err = dx / 2 ;
+        if (steep) {
+            // long axis runs down the screen
+            pixel = x0 * _width + y0 ;
+            major = _width ;
+            minor = (y0 < y1) ? 1 : -1 ;
+        }
+        else {
+            pixel = y0 * _width + x0 ;
+            major = 1 ;
+            minor = (y0 < y1) ? _width : -_width ;
+        }
+
+        for (n = dx; n >= 0; n--) {
+            b = &vga_data_array[pixel >> 1] ;
+            if (pixel & 1) *b = (*b & TOPMASK) | hi ;
+            else *b = (*b & BOTTOMMASK) | lo ;
+            err -= dy ;
+            if (err < 0) {
+                pixel += minor ;
+                err += dx ;
+            }
+            pixel += major ;
+        }
+    }
+}
+
+// Fill pixels x0..x1 (inclusive, on screen) of the scanline at row. A
+// leading odd pixel and a trailing even pixel share their byte with a
+// neighbour and are masked in. The bytes between are written one at a
+// time up to a word boundary, then as 32 bit words. The words go through
+// memcpy, not a uint32_t store into the byte framebuffer, which would
+// break strict aliasing. Telling the compiler the pointer is aligned lets
+// it make each one a single str, even on the M0+, which has no unaligned
+// stores.
+static void fill_span(unsigned char *row, int x0, int x1, unsigned char fill) {
+    unsigned char *b ;
+    unsigned char *end ;
+    uint32_t word = fill * 0x01010101u ;
+
+    if (x0 & 1) {
+        row[x0 >> 1] = (row[x0 >> 1] & TOPMASK) | (fill & ~TOPMASK & 0x3F) ;
+        x0++ ;
+    }
+    if (!(x1 & 1) && x1 >= x0) {
+        row[x1 >> 1] = (row[x1 >> 1] & BOTTOMMASK) | (fill & ~BOTTOMMASK & 0x3F) ;
+        x1-- ;
+    }
+    if (x1 < x0) return ;
+    // whole bytes from x0 / 2 to x1 / 2
+    b = &row[x0 >> 1] ;
+    end = &row[(x1 >> 1) + 1] ;
+    while (b < end && ((uintptr_t)b & 3)) *b++ = fill ;
+    for (; b + 4 <= end; b += 4) memcpy(__builtin_assume_aligned(b, 4), &word, 4) ;
+    while (b < end) *b++ = fill ;
+}
+
+void fillRectFast(short x, short y, short w, short h, char color) {
+    unsigned char fill = color | (color << 3) ;
+    unsigned char *row ;
+    int x1 = x + w - 1 ;
+    int y1 = y + h - 1 ;
+
+    if (w <= 0 || h <= 0 || x1 < 0 || y1 < 0 || x >= _width || y >= _height) return ;
+    if (x < 0) x = 0 ;
+    if (y < 0) y = 0 ;
+    if (x1 >= _width) x1 = _width - 1 ;
+    if (y1 >= _height) y1 = _height - 1 ;
+    vga_mark_rect(x, y, x1 - x + 1, y1 - y + 1) ;
+    for (row = &vga_data_array[y * ROW_BYTES]; y <= y1; y++, row += ROW_BYTES) {
+        fill_span(row, x, x1, fill) ;
+    }
+}
+
+void drawHLineFast(short x, short y, short w, char color) {
+    fillRectFast(x, y, w, 1, color) ;
+}
+
+void drawVLineFast(short x, short y, short h, char color) {
+    unsigned char *b ;
+    unsigned char *end ;
+    unsigned char mask, bits ;
+    int y1 = y + h - 1 ;
+
+    if (h <= 0 || x < 0 || x >= _width || y1 < 0 || y >= _height) return ;
+    if (y < 0) y = 0 ;
+    if (y1 >= _height) y1 = _height - 1 ;
+    vga_mark_rect(x, y, 1, y1 - y + 1) ;
+    // the same half of the same byte column on every row
+    mask = (x & 1) ? TOPMASK : BOTTOMMASK ;
+    bits = (x & 1) ? color << 3 : color ;
+    end = &vga_data_array[y1 * ROW_BYTES + (x >> 1)] ;
+    for (b = &vga_data_array[y * ROW_BYTES + (x >> 1)]; b <= end; b += ROW_BYTES) {
+        *b = (*b & mask) | bits ;
+    }
+}
+
+void drawRectFast(short x, short y, short w, short h, char color) {
+    drawHLineFast(x, y, w, color) ;
+    drawHLineFast(x, y + h - 1, w, color) ;
+    drawVLineFast(x, y, h, color) ;
+    drawVLineFast(x + w - 1, y, h, color) ;
+}
+
+char vga_read_pixel(short x, short y) {
+    unsigned char b = vga_data_array[(_width * y + x) >> 1] ;
+    return (x & 1) ? (b >> 3) & 0x7 : b & 0x7 ;
+}
+
+// Brush half widths: brush_half[r][dy + r] is how far the round brush of
+// radius r reaches left and right on row dy. Filled on first use.
+static signed char brush_half[VGA_BRUSH_MAX + 1][2 * VGA_BRUSH_MAX + 1] ;
+static int brush_ready = 0 ;
+
+static void brush_init(void) {
+    int r, dy, w ;
+    for (r = 0; r <= VGA_BRUSH_MAX; r++) {
+        for (dy = -r; dy <= r; dy++) {
+            for (w = 0; (w + 1) * (w + 1) + dy * dy <= r * r + r; w++) ;
+            brush_half[r][dy + r] = w ;
+        }
+    }
+    brush_ready = 1 ;
+}
+
+const signed char *vga_brush(int radius) {
+    if (radius < 0) radius = 0 ;
+    if (radius > VGA_BRUSH_MAX) radius = VGA_BRUSH_MAX ;
+    if (!brush_ready) brush_init() ;
+    return &brush_half[radius][radius] ;
+}
+
+// Fill pixels lo..hi of scanline y, on screen. Thick-line spans are a few
+// bytes, so plain byte stores beat fill_span here.
+static inline void put_span(int y, int lo, int hi, unsigned char fill) {
+    unsigned char *b = &vga_data_array[y * ROW_BYTES + (lo >> 1)] ;
+    if (lo & 1) {
+        *b = (*b & TOPMASK) | (fill & 0x38) ;
+        b++ ;
+        lo++ ;
+    }
+    for (; lo < hi; lo += 2) *b++ = fill ;
+    if (lo == hi) *b = (*b & BOTTOMMASK) | (fill & 0x07) ;
+}
+
+// put_span clipped to the screen
+static inline void short_span(int y, int lo, int hi, unsigned char fill) {
+    if (y < 0 || y >= _height) return ;
+    if (lo < 0) lo = 0 ;
+    if (hi >= _width) hi = _width - 1 ;
+    if (lo <= hi) put_span(y, lo, hi, fill) ;
+}
+
+// One line of the brush across the long axis: pixels lo..hi of scanline
+// at for steep segments, of column at for shallow ones, clipped
+static inline void brush_line(int steep, int inside, int at, int lo, int hi, unsigned char fill) {
+    unsigned char mask, bits ;
+    unsigned char *b ;
+    if (steep) {
+        if (inside) put_span(at, lo, hi, fill) ;
+        else short_span(at, lo, hi, fill) ;
+        return ;
+    }
+    if (at < 0 || at >= _width) return ;
+    lo = max(lo, 0) ;
+    hi = min(hi, _height - 1) ;
+    mask = (at & 1) ? TOPMASK : BOTTOMMASK ;
+    bits = fill & ~mask & 0x3F ;
+    for (b = &vga_data_array[lo * ROW_BYTES + (at >> 1)]; lo <= hi; lo++, b += ROW_BYTES) {
+        *b = (*b & mask) | bits ;
+    }
+}
+
+void drawThickSegments(const VgaSegment *seg, int count, char color, int radius) {
+    unsigned char fill = color | (color << 3) ;
+    const signed char *half ;
+    int x0, y0, x1, y1, t ;
+    int dx, dy, err, n, steep, ystep ;
+    int x, y ;
+    int bx0, by0, bx1, by1 ;    // the segment's box, grown by the brush
+    int inside, tx, ty ;
+    int cap, cap_x, cap_y ;     // end point to stamp, along and across the long axis
+    unsigned int covered ;      // bit radius + t: the body drew the cap's line t
+    int was_steep = -1 ;        // the previous segment's steep, -1 if it was not drawn
+    int skip_x ;                // step along the long axis drawn by the previous segment
+
+    if (radius <= 0) {
+        drawSegments(seg, count, color) ;
+        return ;
+    }
+    if (radius > VGA_BRUSH_MAX) radius = VGA_BRUSH_MAX ;
+    half = vga_brush(radius) ;
+
+    for (; count > 0; count--, seg++) {
+        x0 = seg->x0 ;
+        y0 = seg->y0 ;
+        x1 = seg->x1 ;
+        y1 = seg->y1 ;
+        // Segments are a few pixels long, so the marking, and clipping
+        // spans only when the brush can leave the screen, count here
+        bx0 = min(x0, x1) - radius ;
+        by0 = min(y0, y1) - radius ;
+        bx1 = max(x0, x1) + radius ;
+        by1 = max(y0, y1) + radius ;
+        inside = bx0 >= 0 && by0 >= 0 && bx1 < _width && by1 < _height ;
+        if (!inside) {
+            if (bx1 < 0 || by1 < 0 || bx0 >= _width || by0 >= _height) {
+                was_steep = -1 ;
+                continue ;
+            }
+            bx0 = max(bx0, 0) ;
+            by0 = max(by0, 0) ;
+            bx1 = min(bx1, _width - 1) ;
+            by1 = min(by1, _height - 1) ;
+        }
+        if (bx1 - bx0 < (1 << VGA_TILE_LOG2) && by1 - by0 < (1 << VGA_TILE_LOG2)) {
+            // no more than 2 x 2 tiles, the corners' tiles are all of them
+            vga_dirty[by0 >> VGA_TILE_LOG2][bx0 >> VGA_TILE_LOG2] = 1 ;
+            vga_dirty[by0 >> VGA_TILE_LOG2][bx1 >> VGA_TILE_LOG2] = 1 ;
+            vga_dirty[by1 >> VGA_TILE_LOG2][bx0 >> VGA_TILE_LOG2] = 1 ;
+            vga_dirty[by1 >> VGA_TILE_LOG2][bx1 >> VGA_TILE_LOG2] = 1 ;
+        }
+        else {
+            for (ty = by0 >> VGA_TILE_LOG2; ty <= (by1 >> VGA_TILE_LOG2); ty++) {
+                for (tx = bx0 >> VGA_TILE_LOG2; tx <= (bx1 >> VGA_TILE_LOG2); tx++) vga_dirty[ty][tx] = 1 ;
+            }
+        }
+
+        // Round cap on the end point, which is the joint with the next
+        // segment of a turtle path. Not needed where the path carries on
+        // straight into the next segment.
+        cap = count == 1 || seg[1].x0 != x1 || seg[1].y0 != y1
+              || seg[1].x1 - x1 != x1 - x0 || seg[1].y1 - y1 != y1 - y0 ;
+
+        // Same stepping as drawSegments. Each pixel becomes a line of
+        // 2 * radius + 1 pixels across the long axis: a horizontal span
+        // for steep segments, a short column for shallow ones.
+        steep = abs(y1 - y0) > abs(x1 - x0) ;
+        cap_x = steep ? y1 : x1 ;
+        cap_y = steep ? x1 : y1 ;
+        // Where the path goes on from the previous segment the same way
+        // round, that segment's last line is this one's first
+        skip_x = (steep == was_steep && x0 == seg[-1].x1 && y0 == seg[-1].y1) ? (steep ? y0 : x0) : INT_MIN ;
+        was_steep = steep ;
+        if (steep) {
+            t = x0 ; x0 = y0 ; y0 = t ;
+            t = x1 ; x1 = y1 ; y1 = t ;
+        }
+        if (x0 > x1) {
+            t = x0 ; x0 = x1 ; x1 = t ;
+            t = y0 ; y0 = y1 ; y1 = t ;
+        }
+        dx = x1 - x0 ;
+        dy = abs(y1 - y0) ;
+        err = dx / 2 ;
+        ystep = (y0 < y1) ? 1 : -1 ;
+        covered = 0 ;
+        for (x = x0, y = y0, n = dx; n >= 0; n--, x++) {
+            if (x != skip_x) brush_line(steep, inside, x, y - radius, y + radius, fill) ;
+            // a body line through the cap's center line holds the cap's
+            // line there, which is no wider
+            if (y == cap_y && abs(x - cap_x) <= radius) covered |= 1u << (x - cap_x + radius) ;
+            err -= dy ;
+            if (err < 0) {
+                y += ystep ;
+                err += dx ;
+            }
+        }
+
+        // The cap, drawn across the long axis as well (the brush is the
+        // same either way round), less the lines the body already drew
+        if (cap) {
+            for (t = -radius; t <= radius; t++) {
+                if (!(covered & (1u << (t + radius)))) brush_line(steep, inside, cap_x + t, cap_y - half[t], cap_y + half[t], fill) ;
+            }
+        }
+    }
+}
+
+void vga_mark_rect(short x, short y, short w, short h) {
+    int tx, ty ;
+    int x1 = x + w - 1 ;
+    int y1 = y + h - 1 ;
+    if (w <= 0 || h <= 0 || x1 < 0 || y1 < 0 || x >= _width || y >= _height) return ;
+    if (x < 0) x = 0 ;
+    if (y < 0) y = 0 ;
+    if (x1 >= _width) x1 = _width - 1 ;
+    if (y1 >= _height) y1 = _height - 1 ;
+    for (ty = y >> VGA_TILE_LOG2; ty <= (y1 >> VGA_TILE_LOG2); ty++) {
+        for (tx = x >> VGA_TILE_LOG2; tx <= (x1 >> VGA_TILE_LOG2); tx++) {
+            vga_dirty[ty][tx] = 1 ;
+        }
+    }
+}
+
+unsigned int vga_clear_dirty(char color) {
+    unsigned char fill = color | (color << 3) ;
+    unsigned int cleared = 0 ;
+    int tx, ty, run, line ;
+    unsigned char *row ;
+
+    for (ty = 0; ty < VGA_TILES_Y; ty++) {
+        row = &vga_data_array[(ty << VGA_TILE_LOG2) * ROW_BYTES] ;
+        for (tx = 0; tx < VGA_TILES_X; tx++) {
+            if (!vga_dirty[ty][tx]) continue ;
+            // neighbouring dirty tiles are cleared as one span per scanline
+            for (run = 0; tx + run < VGA_TILES_X && vga_dirty[ty][tx + run]; run++) {
+                vga_dirty[ty][tx + run] = 0 ;
+            }
+            for (line = 0; line < (1 << VGA_TILE_LOG2); line++) {
+                memset(row + line * ROW_BYTES + tx * TILE_BYTES, fill, run * TILE_BYTES) ;
+            }
+            cleared += run * TILE_BYTES << VGA_TILE_LOG2 ;
+            tx += run ;
+        }
+    }
+    return cleared ;
+}
+
+int vga_layer_capture(VgaLayer *layer) {
+    unsigned int i = 0 ;
+    unsigned int last = 0 ;     // end of the previous run
+    unsigned int start, end, len, skip, y, t ;
+    unsigned int n = 0 ;
+
+    memset(layer->tiles, 0, sizeof(layer->tiles)) ;
+    while (i < TXCOUNT) {
+        if (vga_data_array[i] == 0) {
+            i++ ;
+            continue ;
+        }
+        // a run of non-black bytes, at most 255 long. Black gaps shorter
+        // than a run header are cheaper to copy than to skip.
+        start = i ;
+        end = i ;
+        while (i < TXCOUNT && i - start < 255) {
+            if (vga_data_array[i] != 0) {
+                end = i + 1 ;
+                y = i / ROW_BYTES ;
+                t = (y >> VGA_TILE_LOG2) * VGA_TILES_X + (i - y * ROW_BYTES) / TILE_BYTES ;
+                layer->tiles[t >> 3] |= 1 << (t & 7) ;
+            }
+            else if (i - end >= LAYER_GAP) break ;
+            i++ ;
+        }
+        i = end ;
+        len = end - start ;
+        skip = start - last ;
+        // skips are 16 bits, longer ones are split with empty runs
+        if (n + 3 * (skip / 0xFFFF) + 3 + len > layer->capacity) {
+            layer->size = 0 ;
+            return -1 ;
+        }
+        for (; skip > 0xFFFF; skip -= 0xFFFF) {
+            layer->data[n++] = 0xFF ;
+            layer->data[n++] = 0xFF ;
+            layer->data[n++] = 0 ;
+        }
+        layer->data[n++] = skip & 0xFF ;
+        layer->data[n++] = skip >> 8 ;
+        layer->data[n++] = len ;
+        memcpy(&layer->data[n], &vga_data_array[start], len) ;
+        n += len ;
+        last = i ;
+    }
+    layer->size = n ;
+    return 0 ;
+}
+
+unsigned int vga_layer_restore(const VgaLayer *layer) {
+    const unsigned char *p = layer->data ;
+    const unsigned char *end = layer->data + layer->size ;
+    unsigned char *fb = vga_data_array ;
+    unsigned char *tile = &vga_dirty[0][0] ;
+    unsigned int written = 0 ;
+    unsigned int len, t, bits ;
+
+    while (p < end) {
+        fb += p[0] | (p[1] << 8) ;
+        len = p[2] ;
+        p += 3 ;
+        memcpy(fb, p, len) ;
+        p += len ;
+        fb += len ;
+        written += len ;
+    }
+    // the tiles were found at capture time, so marking costs a pass over
+    // 150 bytes instead of a division per run
+    for (t = 0; t < sizeof(layer->tiles); t++) {
+        for (bits = layer->tiles[t]; bits; bits &= bits - 1) {
+            tile[t * 8 + __builtin_ctz(bits)] = 1 ;
+        }
+    }
+    return written ;
+}
@@ -0,0 +1,87 @@
+// Batched drawing primitives and dirty-tile tracking for the VGA
+// framebuffer. They write vga_data_array directly, so they work both with
+// the RP2040 driver and with vga_graphics_host.c. Build vga_fast.c next to
+// whichever of the two is in use.
+
+#ifndef VGA_FAST_H
+#define VGA_FAST_H
+
+// One line segment, endpoints included
+typedef struct {
+    short x0, y0 ;
+    short x1, y1 ;
+} VgaSegment ;
+
+// Draw count segments in one color. Segments are clipped to the screen
+// (drawLine instead clamps off-screen pixels onto the border). On-screen
+// segments get exactly the pixels drawLine would give them.
+void drawSegments(const VgaSegment *seg, int count, char color) ;
+
+// Clip a segment in place to a width x height screen, as drawSegments
+// does with 640x480. Returns 0 if nothing is left.
+int vga_clip_segment(int *x0, int *y0, int *x1, int *y1, int width, int height) ;
+
+// Draw count segments in one color, 2 * radius + 1 pixels wide (radius
+// clamped to VGA_BRUSH_MAX, 0 = drawSegments). Every pixel drawSegments
+// would set becomes a span across the segment, and the end point gets a
+// round brush stamp so chained segments join smoothly.
+#define VGA_BRUSH_MAX 4
+void drawThickSegments(const VgaSegment *seg, int count, char color, int radius) ;
+// The round brush of a radius (clamped to VGA_BRUSH_MAX) as row half
+// widths: it covers x - half[dy] .. x + half[dy] on row y + dy, for dy from
+// -radius to radius. Shared with the host rasterizer.
+const signed char *vga_brush(int radius) ;
+
+// fillRect, drawHLine and drawVLine as span writes: clipped once, then
+// each scanline is filled with masked edge pixels and aligned 32 bit words
+// in between. Same arguments and, on screen, the same pixels as the
+// driver's versions. They mark their tiles dirty.
+void fillRectFast(short x, short y, short w, short h, char color) ;
+void drawHLineFast(short x, short y, short w, char color) ;
+void drawVLineFast(short x, short y, short h, char color) ;
+// drawRect from the span lines above
+void drawRectFast(short x, short y, short w, short h, char color) ;
+// Color of an on-screen pixel (no clipping)
+char vga_read_pixel(short x, short y) ;
+
+// ---- Dirty tiles ----
+// The screen is tracked in 16x16 pixel tiles. Drawing marks the tiles it
+// touches and vga_clear_dirty wipes only those. drawSegments and the host
+// backend mark automatically. Code drawing through the RP2040 driver marks
+// with vga_mark_pixel/vga_mark_rect. One byte per tile, so both cores can
+// mark without a lock.
+#define VGA_TILE_LOG2 4
+#define VGA_TILES_X (640 >> VGA_TILE_LOG2)
+#define VGA_TILES_Y (480 >> VGA_TILE_LOG2)
+extern unsigned char vga_dirty[VGA_TILES_Y][VGA_TILES_X] ;
+
+// Mark the tile of an on-screen pixel
+#define vga_mark_pixel(x, y) (vga_dirty[(y) >> VGA_TILE_LOG2][(x) >> VGA_TILE_LOG2] = 1)
+// Mark the tiles under a rectangle (same arguments as fillRect), clipped
+void vga_mark_rect(short x, short y, short w, short h) ;
+// Fill every dirty tile with color and mark it clean. Returns the number
+// of framebuffer bytes written (a full-screen clear is 153600).
+unsigned int vga_clear_dirty(char color) ;
+
+// ---- Run-length layers ----
+// A snapshot of the framebuffer's non-black bytes, for static scenery that
+// is drawn once and then restored after every clear. Each run is a 16 bit
+// little-endian skip over black bytes, a length byte and that many literal
+// framebuffer bytes.
+typedef struct {
+    unsigned char *data ;       // encoded runs
+    unsigned int size ;         // bytes of data in use
+    unsigned int capacity ;     // bytes of data available
+    unsigned char tiles[VGA_TILES_X * VGA_TILES_Y / 8] ;   // one bit per tile the layer covers
+} VgaLayer ;
+
+// Encode the whole framebuffer into layer. Returns 0, or -1 if the layer
+// is too small (it is then left empty).
+int vga_layer_capture(VgaLayer *layer) ;
+// Copy the layer's bytes back into the framebuffer and mark their tiles
+// dirty. Pixels that share a byte with a layer pixel get the layer's
+// (black) neighbour, so restore onto a cleared screen. Returns the number
+// of framebuffer bytes written.
+unsigned int vga_layer_restore(const VgaLayer *layer) ;
+
+#endif
@@ -0,0 +1,518 @@
+/**
+ * Host implementation of the vga_graphics API
+ *
+ * Same functions and the same 640x480, 3-bit framebuffer layout as the
+ * RP2040 VGA driver (two pixels per byte, even pixel in bits 0-2, odd
+ * pixel in bits 3-5), but backed by plain RAM with nothing scanning it out.
+ * The drawing algorithms follow the driver, so a scene drawn here matches
+ * the monitor pixel for pixel. Fills and straight lines give the driver's
+ * pixels but are written as spans (fillRectFast and friends in
+ * vga_fast.c). Adds per-call counters, read-back and PPM dumps (see
+ * vga_graphics_host.h) so drawing code can be benchmarked and
+ * regression-tested on a Linux box. Every pixel also marks its tile in the
+ * dirty map of vga_fast.c.
+ *
+ * Build the drawing code together with this file instead of the driver,
+ * with the VGA library directory on the include path for vga_graphics.h
+ * and glcdfont.c:
+ *     cc -O2 -I<vga_graphics dir> scene.c vga_graphics_host.c vga_fast.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vga_graphics.h"
+#include "vga_graphics_host.h"
+#include "vga_fast.h"
+#include "vga_hud.h"
+#include "glcdfont.c"
+
+// The font for vga_hud.c, which has no copy of its own
+const unsigned char *const vga_font = font ;
+
+// Screen size
+#define _width 640
+#define _height 480
+
+// Pixel color array, laid out like the driver's DMA source
+#define TXCOUNT 153600
+unsigned char vga_data_array[TXCOUNT] ;
+
+// Bit masks for drawPixel routine
+#define TOPMASK 0b11000111
+#define BOTTOMMASK 0b11111000
+
+// For drawLine
+#define swap(a, b) { short t = a; a = b; b = t; }
+
+// For writing text
+#define tabspace 4 // number of spaces for a tab
+
+// For accessing the font library
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+// For drawing characters
+unsigned short cursor_y, cursor_x, textsize ;
+char textcolor, textbgcolor, wrap;
+
+VgaHostCounters vga_host_counters ;
+
+void initVGA() {
+    // No PIO or DMA to start, just a blank screen and default text state
+    memset(vga_data_array, 0, TXCOUNT) ;
+    cursor_x = 0 ;
+    cursor_y = 0 ;
+    textsize = 1 ;
+    textcolor = WHITE ;
+    textbgcolor = WHITE ;
+    wrap = 1 ;
+    vga_host_reset_counters() ;
+    vga_host_counters.initVGA++ ;
+}
+
+// A function for drawing a pixel with a specified color.
+// Note that because information is passed to the PIO state machines through
+// a DMA channel, we only need to modify the contents of the array and the
+// pixels will be automatically updated on the screen.
+void drawPixel(short x, short y, char color) {
+    // Range checks (640x480 display)
+    if (x > 639) x = 639 ;
+    if (x < 0) x = 0 ;
+    if (y < 0) y = 0 ;
+    if (y > 479) y = 479 ;
+
+    // Which pixel is it?
+    int pixel = ((640 * y) + x) ;
+    vga_mark_pixel(x, y) ;
+
+    // Is this pixel stored in the first 3 bits
+    // of the vga data array index, or the second
+    // 3 bits? Check, then mask.
+    if (pixel & 1) {
+        vga_data_array[pixel>>1] = (vga_data_array[pixel>>1] & TOPMASK) | (color << 3) ;
+    }
+    else {
+        vga_data_array[pixel>>1] = (vga_data_array[pixel>>1] & BOTTOMMASK) | (color) ;
+    }
+    vga_host_counters.drawPixel++ ;
+    vga_host_counters.pixels++ ;
+}
+
+// The pixels the driver's per-pixel loops give a w x h rectangle. drawPixel
+// clamps each pixel onto the screen, so clamping the corners instead gives
+// the same set, which is then written as spans.
+static void fill_clamped(int x, int y, int w, int h, char color) {
+    int x1 = x + w - 1 ;
+    int y1 = y + h - 1 ;
+    if (w <= 0 || h <= 0) return ;
+    vga_host_counters.pixels += (unsigned long)w * h ;
+    x = (x < 0) ? 0 : (x > _width - 1) ? _width - 1 : x ;
+    x1 = (x1 < 0) ? 0 : (x1 > _width - 1) ? _width - 1 : x1 ;
+    y = (y < 0) ? 0 : (y > _height - 1) ? _height - 1 : y ;
+    y1 = (y1 < 0) ? 0 : (y1 > _height - 1) ? _height - 1 : y1 ;
+    if (x == x1) drawVLineFast(x, y, y1 - y + 1, color) ;
+    else fillRectFast(x, y, x1 - x + 1, y1 - y + 1, color) ;
+}
+
+void drawVLine(short x, short y, short h, char color) {
+    vga_host_counters.drawVLine++ ;
+    fill_clamped(x, y, 1, h, color) ;
+}
+
+void drawHLine(short x, short y, short w, char color) {
+    vga_host_counters.drawHLine++ ;
+    fill_clamped(x, y, w, 1, color) ;
+}
+
+// Bresenham's algorithm - thx wikipedia and thx Bruce!
+void drawLine(short x0, short y0, short x1, short y1, char color) {
+/* Draw a straight line from (x0,y0) to (x1,y1) with given color
+ * Parameters:
+ *      x0: x-coordinate of starting point of line. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y0: y-coordinate of starting point of line. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      x1: x-coordinate of ending point of line. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y1: y-coordinate of ending point of line. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      color: 3-bit color value for line
+ */
+    short steep = abs(y1 - y0) > abs(x1 - x0);
+    vga_host_counters.drawLine++ ;
+    if (steep) {
+        swap(x0, y0);
+        swap(x1, y1);
+    }
+
+    if (x0 > x1) {
+        swap(x0, x1);
+        swap(y0, y1);
+    }
+
+    short dx, dy;
+    dx = x1 - x0;
+    dy = abs(y1 - y0);
+
+    short err = dx / 2;
+    short ystep;
+
+    if (y0 < y1) {
+        ystep = 1;
+    } else {
+        ystep = -1;
+    }
+
+    for (; x0<=x1; x0++) {
+        if (steep) {
+            drawPixel(y0, x0, color);
+        } else {
+            drawPixel(x0, y0, color);
+        }
+        err -= dy;
+        if (err < 0) {
+            y0 += ystep;
+            err += dx;
+        }
+    }
+}
+
+// Draw a rectangle
+void drawRect(short x, short y, short w, short h, char color) {
+/* Draw a rectangle outline with top left vertex (x,y), width w
+ * and height h at given color
+ * Parameters:
+ *      x:  x-coordinate of top-left vertex. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y:  y-coordinate of top-left vertex. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      w:  width of the rectangle
+ *      h:  height of the rectangle
+ *      color:  3-bit color of the rectangle outline
+ * Returns: Nothing
+ */
+    vga_host_counters.drawRect++ ;
+    drawHLine(x, y, w, color);
+    drawHLine(x, y+h-1, w, color);
+    drawVLine(x, y, h, color);
+    drawVLine(x+w-1, y, h, color);
+}
+
+void drawCircle(short x0, short y0, short r, char color) {
+/* Draw a circle outline with center (x0,y0) and radius r, with given color
+ * Parameters:
+ *      x0: x-coordinate of center of circle. The top-left of the screen
+ *          has x-coordinate 0 and increases to the right
+ *      y0: y-coordinate of center of circle. The top-left of the screen
+ *          has y-coordinate 0 and increases to the bottom
+ *      r:  radius of circle
+ *      color: 3-bit color value for the circle. Note that the circle
+ *          isn't filled. So, this is the color of the outline of the circle
+ * Returns: Nothing
+ */
+    short f = 1 - r;
+    short ddF_x = 1;
+    short ddF_y = -2 * r;
+    short x = 0;
+    short y = r;
+
+    vga_host_counters.drawCircle++ ;
+    drawPixel(x0  , y0+r, color);
+    drawPixel(x0  , y0-r, color);
+    drawPixel(x0+r, y0  , color);
+    drawPixel(x0-r, y0  , color);
+
+    while (x<y) {
+        if (f >= 0) {
+            y--;
+            ddF_y += 2;
+            f += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+
+        drawPixel(x0 + x, y0 + y, color);
+        drawPixel(x0 - x, y0 + y, color);
+        drawPixel(x0 + x, y0 - y, color);
+        drawPixel(x0 - x, y0 - y, color);
+        drawPixel(x0 + y, y0 + x, color);
+        drawPixel(x0 - y, y0 + x, color);
+        drawPixel(x0 + y, y0 - x, color);
+        drawPixel(x0 - y, y0 - x, color);
+    }
+}
+
+void drawCircleHelper( short x0, short y0, short r, unsigned char cornername, char color) {
+    // Helper function for drawing circles and circular objects
+    short f     = 1 - r;
+    short ddF_x = 1;
+    short ddF_y = -2 * r;
+    short x     = 0;
+    short y     = r;
+
+    vga_host_counters.drawCircleHelper++ ;
+    while (x<y) {
+        if (f >= 0) {
+            y--;
+            ddF_y += 2;
+            f     += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f     += ddF_x;
+        if (cornername & 0x4) {
+            drawPixel(x0 + x, y0 + y, color);
+            drawPixel(x0 + y, y0 + x, color);
+        }
+        if (cornername & 0x2) {
+            drawPixel(x0 + x, y0 - y, color);
+            drawPixel(x0 + y, y0 - x, color);
+        }
+        if (cornername & 0x8) {
+            drawPixel(x0 - y, y0 + x, color);
+            drawPixel(x0 - x, y0 + y, color);
+        }
+        if (cornername & 0x1) {
+            drawPixel(x0 - y, y0 - x, color);
+            drawPixel(x0 - x, y0 - y, color);
+        }
+    }
+}
+
+void fillCircleHelper(short x0, short y0, short r, unsigned char cornername, short delta, char color) {
+    // Helper function for drawing filled circles
+    short f     = 1 - r;
+    short ddF_x = 1;
+    short ddF_y = -2 * r;
+    short x     = 0;
+    short y     = r;
+
+    vga_host_counters.fillCircleHelper++ ;
+    while (x<y) {
+        if (f >= 0) {
+            y--;
+            ddF_y += 2;
+            f     += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f     += ddF_x;
+
+        if (cornername & 0x1) {
+            drawVLine(x0+x, y0-y, 2*y+1+delta, color);
+            drawVLine(x0+y, y0-x, 2*x+1+delta, color);
+        }
+        if (cornername & 0x2) {
+            drawVLine(x0-x, y0-y, 2*y+1+delta, color);
+            drawVLine(x0-y, y0-x, 2*x+1+delta, color);
+        }
+    }
+}
+
+void fillCircle(short x0, short y0, short r, char color) {
+/* Draw a filled circle with center (x0,y0) and radius r, with given color
+ * Parameters:
+ *      x0: x-coordinate of center of circle. The top-left of the screen
+ *          has x-coordinate 0 and increases to the right
+ *      y0: y-coordinate of center of circle. The top-left of the screen
+ *          has y-coordinate 0 and increases to the bottom
+ *      r:  radius of circle
+ *      color: 3-bit color value for the circle
+ * Returns: Nothing
+ */
+    vga_host_counters.fillCircle++ ;
+    drawVLine(x0, y0-r, 2*r+1, color);
+    fillCircleHelper(x0, y0, r, 3, 0, color);
+}
+
+// Draw a rounded rectangle
+void drawRoundRect(short x, short y, short w, short h, short r, char color) {
+/* Draw a rounded rectangle outline with top left vertex (x,y), width w,
+ * height h and radius of curvature r at given color
+ */
+    vga_host_counters.drawRoundRect++ ;
+    // smarter version
+    drawHLine(x+r  , y    , w-2*r, color); // Top
+    drawHLine(x+r  , y+h-1, w-2*r, color); // Bottom
+    drawVLine(x    , y+r  , h-2*r, color); // Left
+    drawVLine(x+w-1, y+r  , h-2*r, color); // Right
+    // draw four corners
+    drawCircleHelper(x+r    , y+r    , r, 1, color);
+    drawCircleHelper(x+w-r-1, y+r    , r, 2, color);
+    drawCircleHelper(x+w-r-1, y+h-r-1, r, 4, color);
+    drawCircleHelper(x+r    , y+h-r-1, r, 8, color);
+}
+
+// Fill a rounded rectangle
+void fillRoundRect(short x, short y, short w, short h, short r, char color) {
+    vga_host_counters.fillRoundRect++ ;
+    // smarter version
+    fillRect(x+r, y, w-2*r, h, color);
+
+    // draw four corners
+    fillCircleHelper(x+w-r-1, y+r, r, 1, h-2*r-1, color);
+    fillCircleHelper(x+r    , y+r, r, 2, h-2*r-1, color);
+}
+
+// fill a rectangle
+void fillRect(short x, short y, short w, short h, char color) {
+/* Draw a filled rectangle with starting top-left vertex (x,y),
+ *  width w and height h with given color
+ */
+    vga_host_counters.fillRect++ ;
+    fill_clamped(x, y, w, h, color) ;
+}
+
+// Draw a character
+void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) {
+    char i, j;
+    vga_host_counters.drawChar++ ;
+    if((x >= _width)            || // Clip right
+       (y >= _height)           || // Clip bottom
+       ((x + 6 * size - 1) < 0) || // Clip left
+       ((y + 8 * size - 1) < 0))   // Clip top
+        return;
+
+    for (i=0; i<6; i++ ) {
+        unsigned char line;
+        if (i == 5)
+            line = 0x0;
+        else
+            line = pgm_read_byte(font+(c*5)+i);
+        for ( j = 0; j<8; j++) {
+            if (line & 0x1) {
+                if (size == 1) // default size
+                    drawPixel(x+i, y+j, color);
+                else {  // big size
+                    fillRect(x+(i*size), y+(j*size), size, size, color);
+                }
+            } else if (bg != color) {
+                if (size == 1) // default size
+                    drawPixel(x+i, y+j, bg);
+                else {  // big size
+                    fillRect(x+i*size, y+j*size, size, size, bg);
+                }
+            }
+            line >>= 1;
+        }
+    }
+}
+
+void setCursor(short x, short y) {
+/* Set cursor for text to be printed
+ * Parameters:
+ *      x = x-coordinate of top-left of text starting
+ *      y = y-coordinate of top-left of text starting
+ * Returns: Nothing
+ */
+    cursor_x = x;
+    cursor_y = y;
+}
+
+void setTextSize(unsigned char s) {
+/*Set size of text to be displayed
+ * Parameters:
+ *      s = text size (1 being smallest)
+ * Returns: nothing
+ */
+    textsize = (s > 0) ? s : 1;
+}
+
+void setTextColor(char c) {
+    // For 'transparent' background, we'll set the bg
+    // to the same as fg instead of using a flag
+    textcolor = textbgcolor = c;
+}
+
+void setTextColor2(char c, char b) {
+/* Set color of text to be displayed
+ * Parameters:
+ *      c = 3-bit color of text
+ *      b = 3-bit color of text background
+ */
+    textcolor   = c;
+    textbgcolor = b;
+}
+
+void setTextWrap(char w) {
+    wrap = w;
+}
+
+void tft_write(unsigned char c){
+    vga_host_counters.tft_write++ ;
+    if (c == '\n') {
+        cursor_y += textsize*8;
+        cursor_x  = 0;
+    } else if (c == '\r') {
+        // skip em
+    } else if (c == '\t'){
+        int new_x = cursor_x + tabspace;
+        if (new_x < _width){
+            cursor_x = new_x;
+        }
+    } else {
+        drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize);
+        cursor_x += textsize*6;
+        if (wrap && (cursor_x > (_width - textsize*6))) {
+            cursor_y += textsize*8;
+            cursor_x = 0;
+        }
+    }
+}
+
+void writeString(char* str){
+/* Print text onto screen
+ * Call tft_setCursor(), tft_setTextColor(), tft_setTextSize()
+ *  as necessary before printing
+ */
+    vga_host_counters.writeString++ ;
+    while (*str){
+        tft_write(*str++);
+    }
+}
+
+// ---- Host-only additions ----
+
+void vga_host_reset_counters(void) {
+    memset(&vga_host_counters, 0, sizeof(vga_host_counters)) ;
+}
+
+int vga_host_get_pixel(short x, short y) {
+    int pixel ;
+    if (x < 0 || x >= _width || y < 0 || y >= _height) return -1 ;
+    pixel = (_width * y) + x ;
+    if (pixel & 1) return (vga_data_array[pixel>>1] >> 3) & 7 ;
+    return vga_data_array[pixel>>1] & 7 ;
+}
+
+unsigned long vga_host_checksum(void) {
+    unsigned long hash = 2166136261u ;
+    for (int i = 0; i < TXCOUNT; i++) {
+        hash = ((hash ^ vga_data_array[i]) * 16777619u) & 0xFFFFFFFFu ;
+    }
+    return hash ;
+}
+
+int vga_host_dump_ppm(const char *path) {
+    // enum colors is the RGB bits: red in bit 0, green bit 1, blue bit 2
+    unsigned char rgb[_width*3] ;
+    int x, y, c ;
+    FILE *f = fopen(path, "wb") ;
+    if (f == NULL) return -1 ;
+    fprintf(f, "P6\n%d %d\n255\n", _width, _height) ;
+    for (y = 0; y < _height; y++) {
+        for (x = 0; x < _width; x++) {
+            c = vga_host_get_pixel(x, y) ;
+            rgb[3*x]   = (c & 1) ? 255 : 0 ;
+            rgb[3*x+1] = (c & 2) ? 255 : 0 ;
+            rgb[3*x+2] = (c & 4) ? 255 : 0 ;
+        }
+        if (fwrite(rgb, 1, sizeof(rgb), f) != sizeof(rgb)) {
+            fclose(f) ;
+            return -1 ;
+        }
+    }
+    return fclose(f) ? -1 : 0 ;
+}
@@ -0,0 +1,42 @@
+// Host-only additions to the vga_graphics API, for builds that link
+// vga_graphics_host.c instead of the RP2040 VGA driver.
+
+#ifndef VGA_GRAPHICS_HOST_H
+#define VGA_GRAPHICS_HOST_H
+
+// Number of calls to each drawing function since initVGA() or the last
+// vga_host_reset_counters(). Functions that draw through other functions
+// (drawRect through drawHLine/drawVLine, text through drawChar/fillRect)
+// count those inner calls too. fillRect, drawHLine and drawVLine write
+// spans, not drawPixel calls, but count their pixels.
+typedef struct {
+    unsigned long initVGA ;
+    unsigned long drawPixel ;
+    unsigned long drawVLine ;
+    unsigned long drawHLine ;
+    unsigned long drawLine ;
+    unsigned long drawRect ;
+    unsigned long drawCircle ;
+    unsigned long drawCircleHelper ;
+    unsigned long fillCircle ;
+    unsigned long fillCircleHelper ;
+    unsigned long drawRoundRect ;
+    unsigned long fillRoundRect ;
+    unsigned long fillRect ;
+    unsigned long drawChar ;
+    unsigned long tft_write ;
+    unsigned long writeString ;
+    unsigned long pixels ;      // pixels written into the framebuffer
+} VgaHostCounters ;
+
+extern VgaHostCounters vga_host_counters ;
+
+void vga_host_reset_counters(void) ;
+// Color (0..7) of the pixel at x, y, or -1 if off screen
+int vga_host_get_pixel(short x, short y) ;
+// FNV-1a hash of the whole framebuffer, for regression checks
+unsigned long vga_host_checksum(void) ;
+// Write the framebuffer as a binary PPM. Returns 0, or -1 on error.
+int vga_host_dump_ppm(const char *path) ;
+
+#endif
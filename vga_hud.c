@@ -0,0 +1,120 @@
+/**
+ * Change-only HUD text fields (see vga_hud.h)
+ *
+ * The first time a character is needed it is rasterized from the font
+ * into the field's glyph store, pixel for pixel as drawChar draws it
+ * opaque. The framebuffer is never read back, so a clear on the other
+ * core can't leave a blank or half-drawn glyph in the store. A cell at an
+ * even x starts on a byte boundary and is a whole number of bytes wide.
+ * Fields at an odd x, with a size above VGA_HUD_MAX_SIZE or drawn with
+ * bg == color (transparent) still only redraw changed cells, but through
+ * drawChar every time.
+ */
+
+#include <string.h>
+
+#include "vga_graphics.h"
+#include "vga_fast.h"
+#include "vga_hud.h"
+
+// Pixel color array, owned by the VGA driver (or the host backend)
+extern unsigned char vga_data_array[] ;
+
+// Bytes per scanline
+#define ROW_BYTES 320
+
+// Bit masks for the two pixels of a byte
+#define TOPMASK 0b11000111
+#define BOTTOMMASK 0b11111000
+
+void vga_hud_init(VgaHudText *t, short x, short y, unsigned char size, unsigned char cells,
+                  char color, char bg) {
+    t->x = x ;
+    t->y = y ;
+    t->size = size ;
+    t->color = color ;
+    t->bg = bg ;
+    t->cells = cells > VGA_HUD_CELLS ? VGA_HUD_CELLS : cells ;
+    t->glyphs = 0 ;
+    vga_hud_invalidate(t) ;
+}
+
+void vga_hud_invalidate(VgaHudText *t) {
+    memset(t->shown, 0, sizeof(t->shown)) ;
+}
+
+// Glyph store slot of c, or -1
+static int find_glyph(const VgaHudText *t, unsigned char c) {
+    int i ;
+    for (i = 0; i < t->glyphs; i++) {
+        if (t->glyph_char[i] == c) return i ;
+    }
+    return -1 ;
+}
+
+// Rasterize c into glyph, 3 * size bytes per row: five font columns and
+// a blank one, every font pixel a size x size block in color or bg
+static void render_glyph(const VgaHudText *t, unsigned char c, unsigned char *glyph) {
+    int width = 3 * t->size ;
+    int i, j, px, py ;
+    unsigned char line, color ;
+    unsigned char *b ;
+
+    for (i = 0; i < 6; i++) {
+        line = (i == 5) ? 0 : vga_font[c * 5 + i] ;
+        for (j = 0; j < 8; j++, line >>= 1) {
+            color = (line & 1) ? t->color : t->bg ;
+            for (py = j * t->size; py < (j + 1) * t->size; py++) {
+                for (px = i * t->size; px < (i + 1) * t->size; px++) {
+                    b = &glyph[py * width + (px >> 1)] ;
+                    if (px & 1) *b = (*b & TOPMASK) | (color << 3) ;
+                    else *b = (*b & BOTTOMMASK) | color ;
+                }
+            }
+        }
+    }
+}
+
+int vga_hud_print(VgaHudText *t, const char *str) {
+    int width = 3 * t->size ;           // cell width in bytes
+    int height = 8 * t->size ;
+    int cacheable = !(t->x & 1) && t->size <= VGA_HUD_MAX_SIZE && t->bg != t->color
+                    && t->x >= 0 && t->y >= 0 && t->y + height <= 480 ;
+    int redrawn = 0 ;
+    int i, row, g ;
+    short cx ;
+    unsigned char c ;
+    unsigned char *fb ;
+    const unsigned char *glyph ;
+    unsigned char scratch[VGA_HUD_GLYPH_BYTES] ;    // for glyphs the store has no room for
+
+    for (i = 0; i < t->cells; i++) {
+        c = *str ? *str++ : ' ' ;
+        if (t->shown[i] == c) continue ;
+        t->shown[i] = c ;
+        cx = t->x + 6 * t->size * i ;
+        redrawn++ ;
+        if (!cacheable || cx + 6 * t->size > 640) {
+            drawChar(cx, t->y, c, t->color, t->bg, t->size) ;
+            vga_mark_rect(cx, t->y, 6 * t->size, height) ;
+            continue ;
+        }
+        g = find_glyph(t, c) ;
+        if (g < 0 && t->glyphs < VGA_HUD_GLYPHS) {
+            g = t->glyphs++ ;
+            t->glyph_char[g] = c ;
+            render_glyph(t, c, t->glyph[g]) ;
+        }
+        if (g >= 0) glyph = t->glyph[g] ;
+        else {
+            render_glyph(t, c, scratch) ;
+            glyph = scratch ;
+        }
+        fb = &vga_data_array[t->y * ROW_BYTES + (cx >> 1)] ;
+        for (row = 0; row < height; row++) {
+            memcpy(fb + row * ROW_BYTES, &glyph[row * width], width) ;
+        }
+        vga_mark_rect(cx, t->y, 6 * t->size, height) ;
+    }
+    return redrawn ;
+}
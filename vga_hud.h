@@ -0,0 +1,47 @@
+// Change-only text fields for heads-up displays. A field remembers what
+// it is showing and, on every print, redraws only the character cells
+// that changed. Each glyph is rasterized once from the font and kept as
+// framebuffer bytes, so redrawing a cell is a few row copies.
+
+#ifndef VGA_HUD_H
+#define VGA_HUD_H
+
+// Longest field, in character cells
+#define VGA_HUD_CELLS 16
+// Glyphs a field keeps. Further characters are rasterized on every draw.
+#define VGA_HUD_GLYPHS 16
+// Largest text size whose glyphs are kept
+#define VGA_HUD_MAX_SIZE 2
+
+// A cell is 6 x 8 pixels scaled by size, so 3 * size bytes wide
+#define VGA_HUD_GLYPH_BYTES (3 * VGA_HUD_MAX_SIZE * 8 * VGA_HUD_MAX_SIZE)
+
+// The driver's 5x7 font, 5 column bytes per character, that glyphs are
+// rasterized from. It points at the driver's own copy, so an image holds
+// the font once. vga_driver.c (the RP2040 driver) and vga_graphics_host.c
+// define it.
+extern const unsigned char *const vga_font ;
+
+typedef struct {
+    short x, y ;                // top left of the first cell
+    unsigned char size ;        // text size, as for setTextSize
+    char color, bg ;            // cells are drawn opaque in these colors
+    unsigned char cells ;       // field width in cells
+    char shown[VGA_HUD_CELLS] ; // character in each cell, 0 = never drawn
+    unsigned char glyphs ;      // glyphs kept so far
+    unsigned char glyph_char[VGA_HUD_GLYPHS] ;
+    unsigned char glyph[VGA_HUD_GLYPHS][VGA_HUD_GLYPH_BYTES] ;
+} VgaHudText ;
+
+// Set up an empty field of cells characters (at most VGA_HUD_CELLS).
+// Nothing is drawn until the first print.
+void vga_hud_init(VgaHudText *t, short x, short y, unsigned char size, unsigned char cells,
+                  char color, char bg) ;
+// Show str, padded with spaces to the field width and cut to it. Returns
+// the number of cells redrawn. Marks the redrawn cells dirty.
+int vga_hud_print(VgaHudText *t, const char *str) ;
+// Forget what is on screen, so the next print redraws every cell (after
+// the field was cleared or drawn over)
+void vga_hud_invalidate(VgaHudText *t) ;
+
+#endif
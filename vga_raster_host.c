@@ -0,0 +1,321 @@
+/**
+ * Tile-parallel rasterizer for the host (see vga_raster_host.h)
+ *
+ * Binning is a counting sort: one pass counts how many commands touch
+ * each tile, a prefix sum turns the counts into bin offsets, and a second
+ * pass drops each command index into every tile its bounding box covers.
+ * Both passes walk the commands in order, so each bin keeps drawing order
+ * and a tile painted from its bin ends up exactly as in a serial render.
+ *
+ * Tiles are an even number of pixels wide, so no two tiles share a byte
+ * and workers never need a lock. They take the next tile from a shared
+ * counter, which balances dense tiles (a tree trunk, a fern) against
+ * empty sky.
+ *
+ * Inside a tile, a segment starts at the first pixel of its Bresenham
+ * walk that falls in the tile's columns (or rows, for steep segments).
+ * The error term at that step is computed directly, so the tile gets the
+ * same pixels as a walk from the real start point, without walking the
+ * part of the segment outside the tile. Thick segments walk the same way
+ * with the tile's cross-axis range widened by the brush radius, and each
+ * step paints the part of its span that lands in the tile.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vga_raster_host.h"
+
+// Bit masks for the two pixels of a byte
+#define TOPMASK 0b11000111
+#define BOTTOMMASK 0b11111000
+
+#ifndef min
+#define min(a,b) ((a<b) ? a:b)
+#endif
+#ifndef max
+#define max(a,b) ((a<b) ? b:a)
+#endif
+
+int vga_raster_init(VgaRaster *r, int width, int height, int tile) {
+    memset(r, 0, sizeof(*r)) ;
+    if (width <= 0 || height <= 0 || (width & 1) || tile <= 0 || (tile & 1)) return -1 ;
+    r->width = width ;
+    r->height = height ;
+    r->row_bytes = width / 2 ;
+    r->tile = tile ;
+    r->tiles_x = (width + tile - 1) / tile ;
+    r->tiles_y = (height + tile - 1) / tile ;
+    r->data = calloc((size_t)r->row_bytes * height, 1) ;
+    r->bin_start = malloc(sizeof(uint32_t) * (r->tiles_x * r->tiles_y + 1)) ;
+    if (r->data == NULL || r->bin_start == NULL) {
+        vga_raster_free(r) ;
+        return -1 ;
+    }
+    return 0 ;
+}
+
+void vga_raster_free(VgaRaster *r) {
+    free(r->data) ;
+    free(r->cmds) ;
+    free(r->bin_start) ;
+    free(r->bin_cmds) ;
+    memset(r, 0, sizeof(*r)) ;
+}
+
+void vga_raster_reset(VgaRaster *r) {
+    r->count = 0 ;
+}
+
+static int push(VgaRaster *r, int x0, int y0, int x1, int y1, char color, int radius, int cap) {
+    VgaRasterCmd *c ;
+    if (r->count == r->capacity) {
+        unsigned int capacity = r->capacity ? 2 * r->capacity : 4096 ;
+        c = realloc(r->cmds, sizeof(VgaRasterCmd) * capacity) ;
+        if (c == NULL) return -1 ;
+        r->cmds = c ;
+        r->capacity = capacity ;
+    }
+    c = &r->cmds[r->count++] ;
+    c->x0 = x0 ;
+    c->y0 = y0 ;
+    c->x1 = x1 ;
+    c->y1 = y1 ;
+    c->color = color & 0x7 ;
+    c->radius = radius ;
+    c->cap = cap ;
+    return 0 ;
+}
+
+int vga_raster_pixel(VgaRaster *r, short x, short y, char color) {
+    // drawPixel clamps instead of clipping
+    if (x < 0) x = 0 ;
+    if (x >= r->width) x = r->width - 1 ;
+    if (y < 0) y = 0 ;
+    if (y >= r->height) y = r->height - 1 ;
+    return push(r, x, y, x, y, color, 0, 0) ;
+}
+
+int vga_raster_segments(VgaRaster *r, const VgaSegment *seg, int count, char color) {
+    int x0, y0, x1, y1 ;
+    for (; count > 0; count--, seg++) {
+        x0 = seg->x0 ;
+        y0 = seg->y0 ;
+        x1 = seg->x1 ;
+        y1 = seg->y1 ;
+        if (!vga_clip_segment(&x0, &y0, &x1, &y1, r->width, r->height)) continue ;
+        if (push(r, x0, y0, x1, y1, color, 0, 0)) return -1 ;
+    }
+    return 0 ;
+}
+
+int vga_raster_thick_segments(VgaRaster *r, const VgaSegment *seg, int count, char color, int radius) {
+    int x0, y0, x1, y1, cap ;
+    if (radius <= 0) return vga_raster_segments(r, seg, count, color) ;
+    if (radius > VGA_BRUSH_MAX) radius = VGA_BRUSH_MAX ;
+    for (; count > 0; count--, seg++) {
+        x0 = seg->x0 ;
+        y0 = seg->y0 ;
+        x1 = seg->x1 ;
+        y1 = seg->y1 ;
+        // drawThickSegments' test for the round cap at the joint
+        cap = count == 1 || seg[1].x0 != x1 || seg[1].y0 != y1
+              || seg[1].x1 - x1 != x1 - x0 || seg[1].y1 - y1 != y1 - y0 ;
+        // Clipping would move the start of the walk, so only segments that
+        // miss the canvas altogether are dropped
+        if (max(x0, x1) + radius < 0 || min(x0, x1) - radius >= r->width
+            || max(y0, y1) + radius < 0 || min(y0, y1) - radius >= r->height) continue ;
+        if (push(r, x0, y0, x1, y1, color, radius, cap)) return -1 ;
+    }
+    return 0 ;
+}
+
+static inline void put(VgaRaster *r, int x, int y, unsigned char lo, unsigned char hi) {
+    unsigned char *b = &r->data[y * r->row_bytes + (x >> 1)] ;
+    if (x & 1) *b = (*b & TOPMASK) | hi ;
+    else *b = (*b & BOTTOMMASK) | lo ;
+}
+
+// Draw the part of command c that falls in columns cx0..cx1 and rows
+// ry0..ry1 (the whole canvas for a serial render)
+static void draw_cmd(VgaRaster *r, const VgaRasterCmd *c, int cx0, int cx1, int ry0, int ry1) {
+    unsigned char hi = c->color << 3 ;
+    unsigned char lo = c->color ;
+    const signed char *half ;
+    int rad = c->radius ;
+    int x0 = c->x0, y0 = c->y0, x1 = c->x1, y1 = c->y1 ;
+    int t, steep, dx, dy, err, ystep ;
+    int k, k_end, m, major_lo, major_hi, minor_lo, minor_hi ;
+    int x, y, s, s_end ;
+
+    // Round cap on the end point, as drawThickSegments stamps it
+    if (c->cap) {
+        half = vga_brush(rad) ;
+        for (t = max(-rad, ry0 - y1); t <= min(rad, ry1 - y1); t++) {
+            s_end = min(x1 + half[t], cx1) ;
+            for (s = max(x1 - half[t], cx0); s <= s_end; s++) put(r, s, y1 + t, lo, hi) ;
+        }
+    }
+
+    // Same stepping as drawSegments and drawLine
+    steep = abs(y1 - y0) > abs(x1 - x0) ;
+    if (steep) {
+        t = x0 ; x0 = y0 ; y0 = t ;
+        t = x1 ; x1 = y1 ; y1 = t ;
+        major_lo = ry0 ; major_hi = ry1 ;
+        minor_lo = cx0 ; minor_hi = cx1 ;
+    }
+    else {
+        major_lo = cx0 ; major_hi = cx1 ;
+        minor_lo = ry0 ; minor_hi = ry1 ;
+    }
+    if (x0 > x1) {
+        t = x0 ; x0 = x1 ; x1 = t ;
+        t = y0 ; y0 = y1 ; y1 = t ;
+    }
+    dx = x1 - x0 ;
+    dy = abs(y1 - y0) ;
+    ystep = (y0 < y1) ? 1 : -1 ;
+
+    // steps of the walk inside the clip range on the long axis
+    k = major_lo > x0 ? major_lo - x0 : 0 ;
+    k_end = major_hi < x1 ? major_hi - x0 : dx ;
+    if (k > k_end) return ;
+    // After k steps the walk has made m minor steps, the fewest that
+    // keep err = dx / 2 - k * dy + m * dx from going negative
+    err = dx / 2 - k * dy ;
+    m = err < 0 ? (-err + dx - 1) / dx : 0 ;
+    err += m * dx ;
+    y = y0 + m * ystep ;
+
+    // Each step paints y - rad .. y + rad across the long axis, the
+    // part of it inside the clip range
+    for (x = x0 + k; k <= k_end; k++, x++) {
+        if (y + rad >= minor_lo && y - rad <= minor_hi) {
+            s_end = min(y + rad, minor_hi) ;
+            for (s = max(y - rad, minor_lo); s <= s_end; s++) {
+                if (steep) put(r, s, x, lo, hi) ;
+                else put(r, x, s, lo, hi) ;
+            }
+        }
+        // the walk only moves away from the clip range once past it
+        else if ((ystep > 0) ? y - rad > minor_hi : y + rad < minor_lo) break ;
+        err -= dy ;
+        if (err < 0) {
+            y += ystep ;
+            err += dx ;
+        }
+    }
+}
+
+void vga_raster_render_serial(VgaRaster *r) {
+    unsigned int i ;
+    for (i = 0; i < r->count; i++) {
+        draw_cmd(r, &r->cmds[i], 0, r->width - 1, 0, r->height - 1) ;
+    }
+}
+
+// Tiles covered by a command's bounding box, grown by its brush radius
+// and cut to the canvas (thick segments are not clipped)
+static void cmd_tiles(const VgaRaster *r, const VgaRasterCmd *c, int *tx0, int *tx1, int *ty0, int *ty1) {
+    int rad = c->radius ;
+    *tx0 = max(min(c->x0, c->x1) - rad, 0) / r->tile ;
+    *tx1 = min(max(c->x0, c->x1) + rad, r->width - 1) / r->tile ;
+    *ty0 = max(min(c->y0, c->y1) - rad, 0) / r->tile ;
+    *ty1 = min(max(c->y0, c->y1) + rad, r->height - 1) / r->tile ;
+}
+
+static int bin_commands(VgaRaster *r) {
+    int tiles = r->tiles_x * r->tiles_y ;
+    uint32_t *start = r->bin_start ;
+    uint32_t total, n ;
+    unsigned int i ;
+    int tx, ty, tx0, tx1, ty0, ty1 ;
+
+    memset(start, 0, sizeof(uint32_t) * (tiles + 1)) ;
+    for (i = 0; i < r->count; i++) {
+        cmd_tiles(r, &r->cmds[i], &tx0, &tx1, &ty0, &ty1) ;
+        for (ty = ty0; ty <= ty1; ty++) {
+            for (tx = tx0; tx <= tx1; tx++) start[ty * r->tiles_x + tx + 1]++ ;
+        }
+    }
+    // prefix sums: start[t] is the first entry of tile t, start[t + 1] is
+    // its fill position while binning and its end afterwards
+    for (tx = 0, total = 0; tx < tiles; tx++) {
+        n = start[tx + 1] ;
+        start[tx + 1] = total ;
+        total += n ;
+    }
+    if (total > r->bin_capacity) {
+        uint32_t *cmds = realloc(r->bin_cmds, sizeof(uint32_t) * total) ;
+        if (cmds == NULL) return -1 ;
+        r->bin_cmds = cmds ;
+        r->bin_capacity = total ;
+    }
+    for (i = 0; i < r->count; i++) {
+        cmd_tiles(r, &r->cmds[i], &tx0, &tx1, &ty0, &ty1) ;
+        for (ty = ty0; ty <= ty1; ty++) {
+            for (tx = tx0; tx <= tx1; tx++) r->bin_cmds[start[ty * r->tiles_x + tx + 1]++] = i ;
+        }
+    }
+    start[0] = 0 ;
+    return 0 ;
+}
+
+// Shared by the workers of one render
+typedef struct {
+    VgaRaster *r ;
+    int next_tile ;             // next tile to hand out, atomic
+} RenderJob ;
+
+static void *render_worker(void *arg) {
+    RenderJob *job = arg ;
+    VgaRaster *r = job->r ;
+    int tiles = r->tiles_x * r->tiles_y ;
+    int t, cx0, cx1, ry0, ry1 ;
+    uint32_t i ;
+
+    while ((t = __atomic_fetch_add(&job->next_tile, 1, __ATOMIC_RELAXED)) < tiles) {
+        cx0 = (t % r->tiles_x) * r->tile ;
+        ry0 = (t / r->tiles_x) * r->tile ;
+        // the last row and column of tiles can overhang the canvas
+        cx1 = min(cx0 + r->tile - 1, r->width - 1) ;
+        ry1 = min(ry0 + r->tile - 1, r->height - 1) ;
+        for (i = r->bin_start[t]; i < r->bin_start[t + 1]; i++) {
+            draw_cmd(r, &r->cmds[r->bin_cmds[i]], cx0, cx1, ry0, ry1) ;
+        }
+    }
+    return NULL ;
+}
+
+int vga_raster_render_tiled(VgaRaster *r, int threads) {
+    RenderJob job = {r, 0} ;
+    pthread_t *pool ;
+    int i, started ;
+
+    if (bin_commands(r)) return -1 ;
+    pool = threads > 1 ? malloc(sizeof(pthread_t) * threads) : NULL ;
+    for (started = 0; pool != NULL && started < threads; started++) {
+        if (pthread_create(&pool[started], NULL, render_worker, &job)) break ;
+    }
+    // with no workers (one thread asked for, or none could start) this
+    // thread renders every tile itself
+    if (started == 0) render_worker(&job) ;
+    for (i = 0; i < started; i++) pthread_join(pool[i], NULL) ;
+    free(pool) ;
+    return 0 ;
+}
+
+int vga_raster_render(VgaRaster *r, int threads) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN) ;
+
+    // more workers than cores only take turns
+    if (cores > 0 && threads > cores) threads = cores ;
+    if (threads < 2 || r->count < VGA_RASTER_SERIAL_BELOW) {
+        vga_raster_render_serial(r) ;
+        return 0 ;
+    }
+    return vga_raster_render_tiled(r, threads) ;
+}
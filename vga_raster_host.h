@@ -0,0 +1,84 @@
+// Host-only tile-parallel rasterizer for offline renders of large scenes.
+//
+// Drawing calls are queued as commands (the same thick segments and
+// pixels the turtle's lsys_flush and the fern drain hand to
+// drawThickSegments/drawPixel, or thin segments as for drawSegments) and
+// rendered later into a canvas of any size with the framebuffer's layout:
+// 3-bit colors, two pixels per byte, even pixel in bits 0-2.
+// vga_raster_render bins the commands into tiles and rasterizes the tiles
+// on a pool of threads. The result is bit-identical to
+// vga_raster_render_serial, and at 640x480 to making the same calls on the
+// framebuffer. raster_replay_host.c checks both on a scene of the demo.
+//
+// Build with -pthread next to vga_fast.c.
+
+#ifndef VGA_RASTER_HOST_H
+#define VGA_RASTER_HOST_H
+
+#include <stdint.h>
+
+#include "vga_fast.h"
+
+// One queued drawing call: a pixel (clamped), a thin segment (clipped) or
+// a thick segment (not clipped, its brush walk starts at the real end)
+typedef struct {
+    short x0, y0 ;
+    short x1, y1 ;
+    char color ;
+    char radius ;               // brush radius, 0 for pixels and thin segments
+    char cap ;                  // stamp the brush on x1, y1
+} VgaRasterCmd ;
+
+typedef struct {
+    int width, height ;         // canvas size in pixels
+    int row_bytes ;             // width / 2
+    unsigned char *data ;       // canvas, row_bytes * height bytes
+    int tile ;                  // tile size in pixels, even
+    int tiles_x, tiles_y ;
+    VgaRasterCmd *cmds ;        // queued commands, in drawing order
+    unsigned int count ;
+    unsigned int capacity ;
+    uint32_t *bin_start ;       // per tile, first entry in bin_cmds (tiles + 1)
+    uint32_t *bin_cmds ;        // command indices, grouped by tile, in order
+    unsigned int bin_capacity ;
+} VgaRaster ;
+
+// Allocate a black width x height canvas (width even) cut into tile x tile
+// pixel tiles (tile even). Returns 0, or -1 if out of memory.
+int vga_raster_init(VgaRaster *r, int width, int height, int tile) ;
+void vga_raster_free(VgaRaster *r) ;
+// Drop the queued commands (the canvas keeps its pixels)
+void vga_raster_reset(VgaRaster *r) ;
+
+// Queue calls. Same arguments and pixels as drawPixel (off-canvas pixels
+// are clamped onto the border), drawSegments (segments are clipped) and
+// drawThickSegments (same brush, and the same round caps at the joints).
+// Return 0, or -1 if out of memory.
+int vga_raster_pixel(VgaRaster *r, short x, short y, char color) ;
+int vga_raster_segments(VgaRaster *r, const VgaSegment *seg, int count, char color) ;
+int vga_raster_thick_segments(VgaRaster *r, const VgaSegment *seg, int count, char color, int radius) ;
+
+// vga_raster_render draws fewer queued commands than this serially. The
+// binning that the tiled render does first runs on one thread. For the
+// demo's commands, mostly fern pixels and short segments, binning takes
+// longer than drawing them: 8.6 ms for the 377k commands of
+// raster_replay_host's 4K forest, against 6.4 ms for its whole serial
+// render. So no core count can make the tiled render pay for that input.
+// The threshold sits above it until a many-core host shows where tiling
+// starts to win.
+#ifndef VGA_RASTER_SERIAL_BELOW
+#define VGA_RASTER_SERIAL_BELOW 1000000
+#endif
+
+// Draw every queued command into the canvas, one after the other
+void vga_raster_render_serial(VgaRaster *r) ;
+// Draw every queued command using threads workers, one tile at a time
+// (fewer if threads cannot be started). Returns 0, or -1 if out of memory.
+int vga_raster_render_tiled(VgaRaster *r, int threads) ;
+// Draw every queued command the faster way: serially if fewer than
+// VGA_RASTER_SERIAL_BELOW commands are queued or the host has one core,
+// else as vga_raster_render_tiled on up to one thread per core. Returns 0,
+// or -1 if out of memory.
+int vga_raster_render(VgaRaster *r, int threads) ;
+
+#endif
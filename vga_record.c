@@ -0,0 +1,360 @@
+/**
+ * Display list recorder and replayer (see vga_record.h)
+ *
+ * Records are appended with the bytes first and the new size published
+ * after a memory barrier, so another core can replay a list while its
+ * owner is still recording into it and only ever sees whole records. A
+ * pixel run grows the same way, one whole entry at a time.
+ *
+ * Replay calls the ordinary drawing functions (the span versions from
+ * vga_fast.c for rectangles, which clip rather than clamp off-screen
+ * pixels) and marks the dirty tiles of what it draws, so a replayed scene
+ * can be cleared with vga_clear_dirty like a live one.
+ */
+
+#include <string.h>
+
+#include "vga_graphics.h"
+#include "vga_record.h"
+
+// Largest header + timestamp: 1 + 5 bytes
+#define DL_HEAD_MAX 6
+
+// Most lists vga_dl_replay merges
+#define DL_MAX_LISTS 4
+
+void vga_dl_init(VgaDisplayList *dl, unsigned char *buf, unsigned int capacity, uint32_t start_us) {
+    dl->data = buf ;
+    dl->size = 0 ;
+    dl->capacity = capacity ;
+    dl->records = 0 ;
+    dl->dropped = 0 ;
+    dl->overflowed = 0 ;
+    dl->run = 0 ;
+    dl->run_x = 0 ;
+    dl->run_y = 0 ;
+    dl->start_us = start_us ;
+    dl->last_us = start_us ;
+}
+
+// Check that len more bytes fit. The first time they do not, the list is
+// marked overflowed and stops recording: a list with holes in it would
+// replay a different picture.
+static int dl_room(VgaDisplayList *dl, unsigned int len) {
+    if (dl->overflowed || dl->size + len > dl->capacity) {
+        dl->overflowed = 1 ;
+        dl->dropped++ ;
+        return 0 ;
+    }
+    return 1 ;
+}
+
+// Reserve room for a record with len operand bytes and write its header.
+// Returns where the operands go, or NULL if the record does not fit. Any
+// new record closes the open pixel run.
+static unsigned char *dl_begin(VgaDisplayList *dl, uint32_t now, int op, char color, unsigned int len) {
+    unsigned char *p ;
+    uint32_t dt = now - dl->last_us ;
+
+    // a clock that went backwards (another core's timestamp) counts as 0
+    if ((int32_t)dt < 0) {
+        dt = 0 ;
+        now = dl->last_us ;
+    }
+    dl->run = 0 ;
+    if (!dl_room(dl, DL_HEAD_MAX + len)) return NULL ;
+    p = &dl->data[dl->size] ;
+    *p++ = (op << 4) | (color & 0x7) ;
+    for (; dt >= 0x80; dt >>= 7) *p++ = (dt & 0x7F) | 0x80 ;
+    *p++ = dt ;
+    dl->last_us = now ;
+    return p ;
+}
+
+// Publish the bytes up to p
+static void dl_publish(VgaDisplayList *dl, unsigned char *p) {
+    __sync_synchronize() ;
+    dl->size = p - dl->data ;
+}
+
+// Publish a record that ends at p
+static void dl_end(VgaDisplayList *dl, unsigned char *p) {
+    dl_publish(dl, p) ;
+    dl->records++ ;
+}
+
+static unsigned char *put16(unsigned char *p, short v) {
+    p[0] = v & 0xFF ;
+    p[1] = (v >> 8) & 0xFF ;
+    return p + 2 ;
+}
+
+static short get16(const unsigned char *p) {
+    return (short)(p[0] | (p[1] << 8)) ;
+}
+
+void vga_dl_pixel(VgaDisplayList *dl, uint32_t now, short x, short y, char color) {
+    unsigned char *p ;
+    uint32_t v ;
+    int dx = x - dl->run_x ;
+    int near = (y == dl->run_y && dx >= 1 && dx <= 16) ;
+    int opened = 0 ;
+
+    if (dl->run != 0 && dl->data[dl->run] < 255) {
+        if (!dl_room(dl, near ? 1 : 3)) return ;
+        p = &dl->data[dl->size] ;
+    }
+    else {
+        // a new run, whose first pixel is always a long entry
+        p = dl_begin(dl, now, VGA_DL_PIXELS, 0, 1 + 3) ;
+        if (p == NULL) return ;
+        dl->run = p - dl->data ;
+        *p++ = 0 ;
+        near = 0 ;
+        opened = 1 ;
+    }
+    if (near) *p++ = 0x80 | ((color & 0x7) << 4) | (dx - 1) ;
+    else {
+        // same packing as the fern queue: x in bits 0-9, y in bits 10-18
+        v = (x & 0x3FF) | ((y & 0x1FF) << 10) | ((uint32_t)(color & 0x7) << 19) ;
+        *p++ = v >> 16 ;
+        *p++ = (v >> 8) & 0xFF ;
+        *p++ = v & 0xFF ;
+    }
+    // the count goes up before the entry is published, so a replay that
+    // reads it early stops at the published end instead
+    dl->data[dl->run]++ ;
+    dl->run_x = x ;
+    dl->run_y = y ;
+    if (opened) dl_end(dl, p) ;
+    else dl_publish(dl, p) ;
+}
+
+// Segment records, with a radius byte first for thick ones
+static void dl_segments(VgaDisplayList *dl, uint32_t now, const VgaSegment *seg, int count,
+                        char color, int radius) {
+    unsigned char *p ;
+    int n ;
+
+    // long batches are split into records of at most 255 segments
+    while (count > 0) {
+        n = count > 255 ? 255 : count ;
+        if (radius) {
+            p = dl_begin(dl, now, VGA_DL_THICK_SEGMENTS, color, 2 + 8 * n) ;
+            if (p == NULL) return ;
+            *p++ = radius ;
+        }
+        else {
+            p = dl_begin(dl, now, VGA_DL_SEGMENTS, color, 1 + 8 * n) ;
+            if (p == NULL) return ;
+        }
+        *p++ = n ;
+        for (count -= n; n > 0; n--, seg++) {
+            p = put16(p, seg->x0) ;
+            p = put16(p, seg->y0) ;
+            p = put16(p, seg->x1) ;
+            p = put16(p, seg->y1) ;
+        }
+        dl_end(dl, p) ;
+    }
+}
+
+void vga_dl_segments(VgaDisplayList *dl, uint32_t now, const VgaSegment *seg, int count, char color) {
+    dl_segments(dl, now, seg, count, color, 0) ;
+}
+
+void vga_dl_thick_segments(VgaDisplayList *dl, uint32_t now, const VgaSegment *seg, int count,
+                           char color, int radius) {
+    dl_segments(dl, now, seg, count, color, radius) ;
+}
+
+static void dl_box(VgaDisplayList *dl, uint32_t now, int op, short x, short y, short w, short h, char color) {
+    unsigned char *p = dl_begin(dl, now, op, color, 8) ;
+    if (p == NULL) return ;
+    p = put16(p, x) ;
+    p = put16(p, y) ;
+    p = put16(p, w) ;
+    p = put16(p, h) ;
+    dl_end(dl, p) ;
+}
+
+void vga_dl_fill_rect(VgaDisplayList *dl, uint32_t now, short x, short y, short w, short h, char color) {
+    dl_box(dl, now, VGA_DL_FILL_RECT, x, y, w, h, color) ;
+}
+
+void vga_dl_rect(VgaDisplayList *dl, uint32_t now, short x, short y, short w, short h, char color) {
+    dl_box(dl, now, VGA_DL_RECT, x, y, w, h, color) ;
+}
+
+void vga_dl_circle(VgaDisplayList *dl, uint32_t now, short x0, short y0, short r, char color) {
+    unsigned char *p = dl_begin(dl, now, VGA_DL_CIRCLE, color, 6) ;
+    if (p == NULL) return ;
+    p = put16(p, x0) ;
+    p = put16(p, y0) ;
+    p = put16(p, r) ;
+    dl_end(dl, p) ;
+}
+
+void vga_dl_text(VgaDisplayList *dl, uint32_t now, short x, short y, unsigned char size,
+                 char color, char bg, const char *str) {
+    unsigned int len = strlen(str) + 1 ;
+    unsigned char *p = dl_begin(dl, now, VGA_DL_TEXT, color, 6 + len) ;
+    if (p == NULL) return ;
+    p = put16(p, x) ;
+    p = put16(p, y) ;
+    *p++ = size ;
+    *p++ = bg ;
+    memcpy(p, str, len) ;
+    dl_end(dl, p + len) ;
+}
+
+// Replay position in one list
+typedef struct {
+    const unsigned char *p ;    // next record
+    const unsigned char *end ;  // end of the published records
+    uint32_t time ;             // absolute time of the next record
+} DlCursor ;
+
+// Decode the timestamp of the record at c->p, if there is one
+static void dl_peek(DlCursor *c) {
+    const unsigned char *q = c->p + 1 ;
+    uint32_t dt = 0 ;
+    int shift = 0 ;
+    if (c->p >= c->end) return ;
+    do {
+        dt |= (uint32_t)(*q & 0x7F) << shift ;
+        shift += 7 ;
+    } while (*q++ & 0x80) ;
+    c->time += dt ;
+}
+
+// Draw the record at c->p and step past it
+static void dl_draw(DlCursor *c) {
+    const unsigned char *p = c->p ;
+    int op = *p >> 4 ;
+    char color = *p & 0x7 ;
+    short x, y, w, h ;
+    unsigned char size ;
+    VgaSegment seg[16] ;
+    uint32_t v ;
+    int n, k, radius ;
+
+    // skip the header and timestamp, already decoded by dl_peek
+    for (p++; *p & 0x80; p++) ;
+    p++ ;
+    switch (op) {
+    case VGA_DL_PIXELS:
+        // the first entry is a long one, so x and y are set before use
+        x = y = 0 ;
+        for (n = *p++; n > 0 && p < c->end; n--) {
+            if (*p & 0x80) {
+                x += (*p & 0xF) + 1 ;
+                color = (*p >> 4) & 0x7 ;
+                p++ ;
+            }
+            else {
+                v = ((uint32_t)p[0] << 16) | (p[1] << 8) | p[2] ;
+                x = v & 0x3FF ;
+                y = (v >> 10) & 0x1FF ;
+                color = (v >> 19) & 0x7 ;
+                p += 3 ;
+            }
+            drawPixel(x, y, color) ;
+            if (x < 640 && y < 480) vga_mark_pixel(x, y) ;
+        }
+        break ;
+    case VGA_DL_SEGMENTS:
+    case VGA_DL_THICK_SEGMENTS:
+        radius = (op == VGA_DL_THICK_SEGMENTS) ? *p++ : 0 ;
+        // decoded and drawn 16 at a time
+        for (n = *p++; n > 0; n -= k) {
+            for (k = 0; k < n && k < 16; k++, p += 8) {
+                seg[k].x0 = get16(p) ;
+                seg[k].y0 = get16(p + 2) ;
+                seg[k].x1 = get16(p + 4) ;
+                seg[k].y1 = get16(p + 6) ;
+            }
+            drawThickSegments(seg, k, color, radius) ;
+        }
+        break ;
+    case VGA_DL_FILL_RECT:
+    case VGA_DL_RECT:
+        x = get16(p) ;
+        y = get16(p + 2) ;
+        w = get16(p + 4) ;
+        h = get16(p + 6) ;
+        // span fills, which mark their own tiles
+        if (op == VGA_DL_FILL_RECT) fillRectFast(x, y, w, h, color) ;
+        else drawRectFast(x, y, w, h, color) ;
+        p += 8 ;
+        break ;
+    case VGA_DL_CIRCLE:
+        x = get16(p) ;
+        y = get16(p + 2) ;
+        w = get16(p + 4) ;
+        drawCircle(x, y, w, color) ;
+        vga_mark_rect(x - w, y - w, 2 * w + 1, 2 * w + 1) ;
+        p += 6 ;
+        break ;
+    case VGA_DL_TEXT:
+        x = get16(p) ;
+        y = get16(p + 2) ;
+        size = p[4] ;
+        setCursor(x, y) ;
+        setTextSize(size) ;
+        setTextColor2(color, p[5]) ;
+        p += 6 ;
+        n = strlen((const char *)p) ;
+        writeString((char *)p) ;
+        // one line of 6x8 cells
+        vga_mark_rect(x, y, n * 6 * size, 8 * size) ;
+        p += n + 1 ;
+        break ;
+    default:
+        // unknown record, nothing after it can be decoded
+        p = c->end ;
+        break ;
+    }
+    c->p = p ;
+}
+
+unsigned int vga_dl_replay(const VgaDisplayList *const *lists, int count, unsigned int speed_q8,
+                           void (*pace)(uint32_t us)) {
+    DlCursor cur[DL_MAX_LISTS] ;
+    uint32_t t0 ;
+    unsigned int drawn = 0 ;
+    int i, next ;
+
+    if (count > DL_MAX_LISTS) count = DL_MAX_LISTS ;
+    if (count <= 0) return 0 ;
+    // an overflowed list is missing the end of its scene
+    for (i = 0; i < count; i++) {
+        if (lists[i]->overflowed) return 0 ;
+    }
+    t0 = lists[0]->start_us ;
+    for (i = 0; i < count; i++) {
+        cur[i].p = lists[i]->data ;
+        cur[i].end = lists[i]->data + lists[i]->size ;
+        __sync_synchronize() ;
+        cur[i].time = lists[i]->start_us ;
+        if ((int32_t)(cur[i].time - t0) < 0) t0 = cur[i].time ;
+        dl_peek(&cur[i]) ;
+    }
+
+    while (1) {
+        // the list whose next record is oldest
+        next = -1 ;
+        for (i = 0; i < count; i++) {
+            if (cur[i].p >= cur[i].end) continue ;
+            if (next < 0 || (int32_t)(cur[i].time - cur[next].time) < 0) next = i ;
+        }
+        if (next < 0) break ;
+        if (pace != NULL && speed_q8 != 0) {
+            pace((uint32_t)((uint64_t)(cur[next].time - t0) * 256 / speed_q8)) ;
+        }
+        dl_draw(&cur[next]) ;
+        dl_peek(&cur[next]) ;
+        drawn++ ;
+    }
+    return drawn ;
+}
@@ -0,0 +1,81 @@
+// Display lists: a compact binary record of drawing calls, with the time
+// each was made, that can be replayed later through the vga_graphics API.
+// Replay goes through whichever backend is linked (the RP2040 driver or
+// vga_graphics_host.c), so a scene recorded on the board can be re-drawn
+// on the host and compared pixel for pixel.
+//
+// Each list has a single writer. Use one list per core and hand them all
+// to vga_dl_replay, which merges them by timestamp. A list that runs out of
+// room stops recording and is marked overflowed; vga_dl_replay refuses it,
+// so the caller can redraw the scene some other way instead of showing
+// part of it.
+
+#ifndef VGA_RECORD_H
+#define VGA_RECORD_H
+
+#include <stdint.h>
+
+#include "vga_fast.h"
+
+// Record layout: one header byte (opcode in the high nibble, color in the
+// low 3 bits), the time since the previous record in microseconds (7 bits
+// per byte, high bit = more), then the opcode's operands.
+enum {
+    VGA_DL_PIXELS,      // count byte, then count pixels (see below)
+    VGA_DL_SEGMENTS,    // count byte, then x0 y0 x1 y1 (16 bit each) per segment
+    VGA_DL_FILL_RECT,   // x y w h, 16 bit each
+    VGA_DL_RECT,        // x y w h, 16 bit each
+    VGA_DL_CIRCLE,      // x0 y0 r, 16 bit each
+    VGA_DL_TEXT,        // x y (16 bit), size, background color, NUL-terminated string
+    VGA_DL_THICK_SEGMENTS,  // radius byte, then as VGA_DL_SEGMENTS
+} ;
+
+// A VGA_DL_PIXELS run holds up to 255 pixels, each with its own color (the
+// header's color is unused). A pixel 1 to 16 columns right of the previous
+// one on the same row takes one byte, 0x80 | color << 4 | (dx - 1). Any
+// other is three bytes, high bit clear: color << 19 | y << 10 | x, most
+// significant byte first. The whole run is replayed at the time of its
+// first pixel.
+
+typedef struct {
+    unsigned char *data ;       // encoded records
+    unsigned int size ;         // bytes of data in use, published last
+    unsigned int capacity ;     // bytes of data available
+    unsigned int records ;      // records stored
+    unsigned int dropped ;      // records refused after the list overflowed
+    int overflowed ;            // a record did not fit, nothing is recorded after it
+    unsigned int run ;          // offset of the open pixel run's count byte, 0 if none
+    short run_x, run_y ;        // last pixel of the open run
+    uint32_t start_us ;         // time the list was started
+    uint32_t last_us ;          // time of the newest record
+} VgaDisplayList ;
+
+// Start an empty list in buf. Timestamps are taken from the caller's clock
+// (time_us_32 on the board) and stored relative to start_us.
+void vga_dl_init(VgaDisplayList *dl, unsigned char *buf, unsigned int capacity, uint32_t start_us) ;
+
+// Append one call each. Once a record does not fit, it and every later one
+// are counted in dropped. Pixels are appended to the newest record while
+// that is a run with room left.
+void vga_dl_pixel(VgaDisplayList *dl, uint32_t now, short x, short y, char color) ;
+void vga_dl_segments(VgaDisplayList *dl, uint32_t now, const VgaSegment *seg, int count, char color) ;
+// Segments for drawThickSegments, radius 0 is recorded as plain segments
+void vga_dl_thick_segments(VgaDisplayList *dl, uint32_t now, const VgaSegment *seg, int count,
+                           char color, int radius) ;
+void vga_dl_fill_rect(VgaDisplayList *dl, uint32_t now, short x, short y, short w, short h, char color) ;
+void vga_dl_rect(VgaDisplayList *dl, uint32_t now, short x, short y, short w, short h, char color) ;
+void vga_dl_circle(VgaDisplayList *dl, uint32_t now, short x0, short y0, short r, char color) ;
+void vga_dl_text(VgaDisplayList *dl, uint32_t now, short x, short y, unsigned char size,
+                 char color, char bg, const char *str) ;
+
+// Draw the records of count lists in timestamp order. Before each record
+// pace(t) is called with the record's time since the earliest list start,
+// scaled by 256 / speed_q8 (256 = as recorded, 512 = twice as fast). pace
+// should wait until that time. With pace NULL or speed_q8 0 the lists are
+// drawn as fast as possible. Text changes the cursor, size and colors.
+// Returns the number of records drawn. If any list overflowed nothing is
+// drawn and 0 is returned.
+unsigned int vga_dl_replay(const VgaDisplayList *const *lists, int count, unsigned int speed_q8,
+                           void (*pace)(uint32_t us)) ;
+
+#endif